@@ -0,0 +1,506 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <complex>
+#include <cstddef>
+#include <map>
+#include <numbers>
+#include <utility>
+#include <vector>
+
+// header only fft for the tiny transforms of the segments: no plan lookup and no library
+// call. every 7-smooth length up to builtinFFTMax has a kernel unrolled at compile time with
+// its roots as constants, other lengths run the same mixed radix steps with run time sizes.
+// like fftw's batched plans the simd lanes run side by side transforms, so the kernels are
+// straight line vector code whatever the length.
+// unnormalized both ways, forward is e^(-2 pi i k n / N) like fftw
+
+constexpr size_t builtinFFTMax = 128;
+
+// lengths whose roots each thread keeps for the lengths without a kernel
+constexpr size_t builtinRootLengths = 16;
+
+#if defined(__AVX512F__)
+constexpr size_t builtinFFTVectorBytes = 64;
+#else
+constexpr size_t builtinFFTVectorBytes = 32;
+#endif
+
+constexpr size_t smallestFactor(size_t n) {
+    for (size_t p = 2; p * p <= n; p++) {
+        if (n % p == 0) return p;
+    }
+    return n;
+}
+
+// radix of each decimation step, 4 while it divides so most twiddles are +-1 and +-i
+constexpr size_t fftRadix(size_t n) {
+    return n % 4 == 0 ? 4 : smallestFactor(n);
+}
+
+// cos and sin of 2 pi k / n as constant expressions: reduced to a quarter turn and then to
+// within pi/4 of an axis, where the series converge to full precision in a few terms
+constexpr std::pair<long double, long double> unitRoot(size_t k, size_t n) {
+    constexpr long double pi = std::numbers::pi_v<long double>;
+    k %= n;
+    size_t quadrant = 4 * k / n;
+    long double x = 2 * pi * (long double)(4 * k - quadrant * n) / (4 * (long double)n);
+
+    bool swap = x > pi / 4;
+    if (swap) x = pi / 2 - x;
+
+    long double c = 1, s = x, termC = 1, termS = x;
+    for (int i = 1; i < 14; i++) {
+        termC *= -x * x / ((2 * i - 1) * (2 * i));
+        termS *= -x * x / ((2 * i) * (2 * i + 1));
+        c += termC;
+        s += termS;
+    }
+    if (swap) std::swap(c, s);
+
+    switch (quadrant) {
+        case 0: return {c, s};
+        case 1: return {-s, c};
+        case 2: return {-c, -s};
+        default: return {s, -c};
+    }
+}
+
+// 2^a 3^b 5^c 7^d, the lengths with kernels
+constexpr bool isSmoothLength(size_t n) {
+    if (n == 0) return false;
+    for (size_t p : {2, 3, 5, 7}) {
+        while (n % p == 0) n /= p;
+    }
+    return n == 1;
+}
+
+// per thread values by length, at most builtinRootLengths of them with the least recently
+// used going first. entries never move, and the one just returned is never the one evicted,
+// so a caller can hold it across the lookup of another length
+template<typename T>
+class LengthCache {
+public:
+    T& operator[](size_t N) {
+        auto it = entries.find(N);
+        if (it == entries.end()) {
+            if (entries.size() >= builtinRootLengths) {
+                entries.erase(std::ranges::min_element(entries, {}, [](auto& e) { return e.second.used; }));
+            }
+            it = entries.try_emplace(N).first;
+        }
+        it->second.used = ++clock;
+        return it->second.value;
+    }
+
+private:
+    struct Entry {
+        T value;
+        size_t used = 0;
+    };
+    std::map<size_t, Entry> entries;
+    size_t clock = 0;
+};
+
+template<typename Real>
+struct BuiltinFFT {
+    using Complex = std::complex<Real>;
+
+    // one value of lanes transforms, split into real and imaginary vectors
+    typedef Real Vec __attribute__((vector_size(builtinFFTVectorBytes)));
+    static constexpr size_t lanes = builtinFFTVectorBytes / sizeof(Real);
+
+    struct Wide {
+        Vec re, im;
+
+        Wide operator+(const Wide& b) const { return {re + b.re, im + b.im}; }
+        Wide operator-(const Wide& b) const { return {re - b.re, im - b.im}; }
+        Wide& operator+=(const Wide& b) { re += b.re; im += b.im; return *this; }
+    };
+
+    using KernelFn = void (*)(const Wide* in, size_t stride, Wide* out);
+
+    static Wide mul(const Wide& a, Complex w) {
+        return {a.re * w.real() - a.im * w.imag(), a.re * w.imag() + a.im * w.real()};
+    }
+
+    // multiply by -i forward, +i inverse
+    static Wide rotate(const Wide& a, bool inverse) {
+        return inverse ? Wide{-a.im, a.re} : Wide{a.im, -a.re};
+    }
+
+    // e^(-+2 pi i k / n)
+    static constexpr Complex root(size_t k, size_t n, bool inverse) {
+        auto [c, s] = unitRoot(k, n);
+        return Complex((Real)c, (Real)(inverse ? s : -s));
+    }
+
+    // out holds P sub transforms of length M back to back, bin k of each becomes bins
+    // k, k + M, ... of their P * M transform. w are the roots of P * M, every step-th entry
+    template<size_t P>
+    [[gnu::always_inline]] static void butterfly(Wide* out, size_t k, size_t M, const Complex* w, size_t step, bool inverse) {
+        Wide t[P];
+        t[0] = out[k];
+        for (size_t j = 1; j < P; j++) t[j] = k ? mul(out[j * M + k], w[j * k * step]) : out[j * M + k];
+
+        if constexpr (P == 2) {
+            out[k] = t[0] + t[1];
+            out[M + k] = t[0] - t[1];
+        } else if constexpr (P == 4) {
+            Wide a = t[0] + t[2], b = t[0] - t[2];
+            Wide c = t[1] + t[3], d = rotate(t[1] - t[3], inverse);
+            out[k] = a + c;
+            out[M + k] = b + d;
+            out[2 * M + k] = a - c;
+            out[3 * M + k] = b - d;
+        } else {
+            for (size_t q = 0; q < P; q++) {
+                Wide sum = t[0];
+                for (size_t j = 1; j < P; j++) sum += mul(t[j], w[(j * q % P) * M * step]);
+                out[q * M + k] = sum;
+            }
+        }
+    }
+
+    // a prime radix without a fixed size butterfly, t is P values of scratch
+    static void butterfly(Wide* out, size_t k, size_t M, size_t P, const Complex* w, size_t step, Wide* t) {
+        t[0] = out[k];
+        for (size_t j = 1; j < P; j++) t[j] = mul(out[j * M + k], w[j * k * step]);
+
+        for (size_t q = 0; q < P; q++) {
+            Wide sum = t[0];
+            for (size_t j = 1; j < P; j++) sum += mul(t[j], w[(j * q % P) * M * step]);
+            out[q * M + k] = sum;
+        }
+    }
+
+    // decimation in time with the length fixed, so every loop unrolls and every root
+    // index is a constant. out[0, N) = dft of in[0], in[stride], ... in[(N - 1) * stride]
+    template<size_t N, bool Inverse>
+    struct Kernel {
+        static constexpr std::array<Complex, N> w = [] {
+            std::array<Complex, N> a;
+            for (size_t k = 0; k < N; k++) a[k] = root(k, N, Inverse);
+            return a;
+        }();
+
+        [[gnu::always_inline]] static void run(const Wide* in, size_t stride, Wide* out) {
+            if constexpr (N == 1) {
+                out[0] = in[0];
+            } else {
+                constexpr size_t P = fftRadix(N);
+                constexpr size_t M = N / P;
+                for (size_t j = 0; j < P; j++) Kernel<M, Inverse>::run(in + j * stride, stride * P, out + j * M);
+#pragma GCC unroll 32
+                for (size_t k = 0; k < M; k++) butterfly<P>(out, k, M, w.data(), 1, Inverse);
+            }
+        }
+
+        // the table entry, everything below it inlined
+        static void entry(const Wide* in, size_t stride, Wide* out) {
+            run(in, stride, out);
+        }
+    };
+
+    template<size_t N, bool Inverse>
+    static constexpr KernelFn kernelFor() {
+        if constexpr (isSmoothLength(N)) return &Kernel<N, Inverse>::entry;
+        else return nullptr;
+    }
+
+    template<bool Inverse, size_t... N>
+    static constexpr std::array<KernelFn, sizeof...(N)> kernelTable(std::index_sequence<N...>) {
+        return {kernelFor<N, Inverse>()...};
+    }
+
+    static constexpr auto forwardKernels = kernelTable<false>(std::make_index_sequence<builtinFFTMax + 1>());
+    static constexpr auto inverseKernels = kernelTable<true>(std::make_index_sequence<builtinFFTMax + 1>());
+
+    static KernelFn kernel(size_t N, bool inverse) {
+        if (N > builtinFFTMax) return nullptr;
+        return inverse ? inverseKernels[N] : forwardKernels[N];
+    }
+
+    // the tables' own condition, so callers never instantiate them
+    static constexpr bool hasKernel(size_t N) {
+        return N <= builtinFFTMax && isSmoothLength(N);
+    }
+
+    // any length: the same steps as the kernels down to a length that has one. a large
+    // prime factor p costs p^2 per butterfly, the segments' smooth lengths never have one
+    static void run(const Wide* in, size_t stride, Wide* out, size_t N, bool inverse,
+                    const Complex* w, size_t step) {
+        if (KernelFn fn = kernel(N, inverse)) return fn(in, stride, out);
+        if (N == 1) {
+            out[0] = in[0];
+            return;
+        }
+
+        size_t P = fftRadix(N);
+        size_t M = N / P;
+        for (size_t j = 0; j < P; j++) run(in + j * stride, stride * P, out + j * M, M, inverse, w, step * P);
+
+        std::vector<Wide> t(P > 7 ? P : 0);
+        for (size_t k = 0; k < M; k++) {
+            switch (P) {
+                case 2: butterfly<2>(out, k, M, w, step, inverse); break;
+                case 3: butterfly<3>(out, k, M, w, step, inverse); break;
+                case 4: butterfly<4>(out, k, M, w, step, inverse); break;
+                case 5: butterfly<5>(out, k, M, w, step, inverse); break;
+                case 7: butterfly<7>(out, k, M, w, step, inverse); break;
+                default: butterfly(out, k, M, P, w, step, t.data()); break;
+            }
+        }
+    }
+
+    // roots for the lengths without a kernel, both directions of a length kept together
+    static const std::vector<Complex>& rootTable(size_t N, bool inverse) {
+        thread_local LengthCache<std::array<std::vector<Complex>, 2>> tables;
+        std::vector<Complex>& w = tables[N][inverse];
+        if (w.empty()) {
+            w.resize(N);
+            for (size_t k = 0; k < N; k++) w[k] = root(k, N, inverse);
+        }
+        return w;
+    }
+
+    // out of place, in and out must not overlap
+    static void dft(const Wide* in, Wide* out, size_t N, bool inverse) {
+        if (KernelFn fn = kernel(N, inverse)) return fn(in, 1, out);
+        run(in, 1, out, N, inverse, rootTable(N, inverse).data(), 1);
+    }
+
+    static Wide* scratch(size_t n) {
+        thread_local std::vector<Wide> buffer;
+        if (buffer.size() < n) buffer.resize(n);
+        return buffer.data();
+    }
+
+    // value(l, i) is sample i of the l-th of n transforms. the vectors are put together in
+    // registers, lanes past n repeat the last transform and are never stored
+    template<bool Full, typename F, size_t... L>
+    [[gnu::always_inline]] static Wide gather(size_t n, size_t i, F& value, std::index_sequence<L...>) {
+        Complex c[] = {value(Full ? L : std::min(L, n - 1), i)...};
+        return {Vec{c[L].real()...}, Vec{c[L].imag()...}};
+    }
+
+    template<typename F>
+    static void load(Wide* to, size_t N, size_t n, F&& value) {
+        if (n == lanes) {
+            for (size_t i = 0; i < N; i++) to[i] = gather<true>(n, i, value, std::make_index_sequence<lanes>());
+        } else {
+            for (size_t i = 0; i < N; i++) to[i] = gather<false>(n, i, value, std::make_index_sequence<lanes>());
+        }
+    }
+
+    // put(l, i, value) for sample i of the first n transforms
+    template<typename F, size_t... L>
+    [[gnu::always_inline]] static void scatter(const Wide& v, size_t n, size_t i, F& put, std::index_sequence<L...>) {
+        ((L < n ? put(L, i, Complex(v.re[L], v.im[L])) : void()), ...);
+    }
+
+    template<typename F>
+    static void store(const Wide* from, size_t N, size_t n, F&& put) {
+        for (size_t i = 0; i < N; i++) scatter(from[i], n, i, put, std::make_index_sequence<lanes>());
+    }
+
+    // the same a cache line of each transform's samples at a time, slower per sample. for
+    // more outputs a multiple of 4 KiB apart than l1 has ways: they share a cache set, and
+    // sample by sample they would keep evicting each other's lines
+    template<typename F>
+    static void storeLines(const Wide* from, size_t N, size_t n, F&& put) {
+        constexpr size_t line = 64 / sizeof(Real);
+        for (size_t i = 0; i < N; i += line) {
+            size_t end = std::min(N, i + line);
+            for (size_t l = 0; l < n; l++) {
+                for (size_t j = i; j < end; j++) put(l, j, Complex(from[j].re[l], from[j].im[l]));
+            }
+        }
+    }
+
+    // count transforms of length N back to back, in place
+    static void transform(Complex* data, size_t N, size_t count, bool inverse) {
+        Wide* temp = scratch(2 * N);
+        for (size_t c = 0; c < count; c += lanes) {
+            size_t n = std::min(lanes, count - c);
+            Complex* group = data + c * N;
+
+            load(temp, N, n, [&](size_t l, size_t i) { return group[l * N + i]; });
+            dft(temp, temp + N, N, inverse);
+            store(temp + N, N, n, [&](size_t l, size_t i, Complex v) { group[l * N + i] = v; });
+        }
+    }
+
+    // real signals go two to a complex transform, x + i y. its bins Z_k and conj Z_(N-k)
+    // separate into X_k = (Z_k + conj Z_(N-k)) / 2 and Y_k = (Z_k - conj Z_(N-k)) / 2i, so a
+    // batch of real transforms is half as many complex ones. signal 2l of a group is the
+    // real part of lane l, signal 2l + 1 the imaginary part
+
+    // count real signals of N samples -> count half spectra of N / 2 + 1 bins
+    static void forwardReal(const Real* in, Complex* out, size_t N, size_t count) {
+        Wide* temp = scratch(3 * N);
+        size_t bins = N / 2 + 1;
+        for (size_t c = 0; c < count; c += 2 * lanes) {
+            size_t m = std::min(2 * lanes, count - c);
+            const Real* x = in + c * N;
+
+            load(temp, N, (m + 1) / 2, [&](size_t l, size_t i) {
+                return Complex(x[2 * l * N + i], 2 * l + 1 < m ? x[(2 * l + 1) * N + i] : 0);
+            });
+            dft(temp, temp + N, N, false);
+
+            const Wide* z = temp + N;
+            for (size_t k = 0; k < bins; k++) {
+                const Wide& a = z[k];
+                const Wide& b = z[k ? N - k : 0];
+                temp[k] = {(a.re + b.re) * Real(0.5), (a.im - b.im) * Real(0.5)};
+                temp[2 * N + k] = {(a.im + b.im) * Real(0.5), (b.re - a.re) * Real(0.5)};
+            }
+
+            Complex* to = out + c * bins;
+            store(temp, bins, (m + 1) / 2, [&](size_t l, size_t k, Complex v) { to[2 * l * bins + k] = v; });
+            store(temp + 2 * N, bins, m / 2, [&](size_t l, size_t k, Complex v) { to[(2 * l + 1) * bins + k] = v; });
+        }
+    }
+
+    // the inverse, Z_k = X_k + i Y_k with the missing halves mirrored back. like fftw's c2r
+    // the imaginary parts of the dc and nyquist bins drop out, here before they can leak
+    // into the other signal of the pair
+    static void backwardReal(const Complex* in, Real* out, size_t N, size_t count) {
+        size_t bins = N / 2 + 1;
+        Wide* temp = scratch(2 * N + 2 * bins);
+        Wide* x = temp + 2 * N;
+        Wide* y = x + bins;
+        for (size_t c = 0; c < count; c += 2 * lanes) {
+            size_t m = std::min(2 * lanes, count - c);
+            const Complex* from = in + c * bins;
+
+            load(x, bins, (m + 1) / 2, [&](size_t l, size_t k) { return from[2 * l * bins + k]; });
+            load(y, bins, (m + 1) / 2, [&](size_t l, size_t k) {
+                return 2 * l + 1 < m ? from[(2 * l + 1) * bins + k] : Complex(0, 0);
+            });
+            x[0].im = y[0].im = Vec{};
+            if (N % 2 == 0) x[N / 2].im = y[N / 2].im = Vec{};
+
+            for (size_t k = 0; k < bins; k++) temp[k] = {x[k].re - y[k].im, x[k].im + y[k].re};
+            for (size_t k = bins; k < N; k++) temp[k] = {x[N - k].re + y[N - k].im, y[N - k].re - x[N - k].im};
+            dft(temp, temp + N, N, true);
+
+            // 2 * lanes outputs N samples apart
+            Real* to = out + c * N;
+            auto put = [&](size_t l, size_t i, Complex v) {
+                to[2 * l * N + i] = v.real();
+                if (2 * l + 1 < m) to[(2 * l + 1) * N + i] = v.imag();
+            };
+            if (N * sizeof(Real) % 4096 == 0) storeLines(temp + N, N, (m + 1) / 2, put);
+            else store(temp + N, N, (m + 1) / 2, put);
+        }
+    }
+
+    // inverses of count spectra zero padded to N = r * P, as r length P inverses per spectrum
+    // (see BasicFFT::backwardPrunedMany). spectrum(g, i) is bin i of the g-th one's phase
+    // spectra before the twiddles, tw the twiddles of phase s at s * P. they go on as the
+    // lanes are loaded and the phases are stored straight to their interleaved outputs
+    template<typename F, typename G>
+    static void pruned(size_t N, size_t P, size_t count, const Complex* tw, F&& spectrum, G&& put) {
+        Wide* temp = scratch(2 * P);
+        size_t r = N / P;
+        size_t phase[lanes], spectra[lanes];
+        for (size_t c = 0; c < count * r; c += lanes) {
+            size_t n = std::min(lanes, count * r - c);
+            for (size_t l = 0; l < n; l++) {
+                spectra[l] = (c + l) / r;
+                phase[l] = (c + l) % r;
+            }
+
+            load(temp, P, n, [&](size_t l, size_t i) { return spectrum(spectra[l], i) * tw[phase[l] * P + i]; });
+            dft(temp, temp + P, P, true);
+            store(temp + P, P, n, [&](size_t l, size_t j, Complex v) { put(spectra[l], j * r + phase[l], v); });
+        }
+    }
+
+    // rows k < K of the real and imaginary parts of the forward roots of N, k * n mod N along
+    // row k, each row padded to whole vectors. kept per thread by N and grown as K grows, in
+    // Wides for the vector alignment
+    static const Real* lowRoots(size_t N, size_t K) {
+        thread_local LengthCache<std::vector<Wide>> tables;
+        size_t vecs = (N + lanes - 1) / lanes;
+        std::vector<Wide>& t = tables[N];
+        if (t.size() < K * vecs) {
+            const Complex* w = rootTable(N, false).data();
+            for (size_t k = t.size() / vecs; k < K; k++) {
+                t.resize((k + 1) * vecs, Wide{});
+                Real* row = (Real*)(t.data() + k * vecs);
+                for (size_t n = 0, j = 0; n < N; n++, j = j + k < N ? j + k : j + k - N) {
+                    row[n] = w[j].real();
+                    row[vecs * lanes + n] = w[j].imag();
+                }
+            }
+        }
+        return (const Real*)t.data();
+    }
+
+    // the lowest K bins of the spectra of count real signals straight from the definition,
+    // K * N multiply adds per transform along the samples. for small K that is less than any
+    // whole transform
+    static void forwardLow(const Real* in, Complex* out, size_t N, size_t K, size_t count) {
+        const Real* roots = lowRoots(N, K);
+        size_t stride = (N + lanes - 1) / lanes * lanes;
+        size_t whole = N / lanes * lanes;
+        for (size_t g = 0; g < count; g++) {
+            const Real* x = in + g * N;
+            for (size_t k = 0; k < K; k++) {
+                const Real* c = roots + 2 * k * stride;
+                const Real* s = c + stride;
+
+                Vec re{}, im{};
+                for (size_t n = 0; n < whole; n += lanes) {
+                    Vec v;
+                    __builtin_memcpy(&v, x + n, sizeof(Vec));
+                    re += v * *(const Vec*)(c + n);
+                    im += v * *(const Vec*)(s + n);
+                }
+
+                Real sumRe = 0, sumIm = 0;
+                for (size_t l = 0; l < lanes; l++) {
+                    sumRe += re[l];
+                    sumIm += im[l];
+                }
+                for (size_t n = whole; n < N; n++) {
+                    sumRe += x[n] * c[n];
+                    sumIm += x[n] * s[n];
+                }
+                out[g * K + k] = Complex(sumRe, sumIm);
+            }
+        }
+    }
+
+    // count dct-ii of N samples (fftw's REDFT10), or with inverse the dct-iii (REDFT01), out
+    // of place. one complex transform of the same length each: even samples forward and odd
+    // ones backward make the cosines a quarter bin rotation of its bins (makhoul)
+    static void dct(const Real* in, Real* out, size_t N, size_t count, bool inverse) {
+        Wide* temp = scratch(2 * N);
+        const Complex* w = rootTable(4 * N, false).data();
+        auto sample = [N](size_t i) { return i < (N + 1) / 2 ? 2 * i : 2 * (N - 1 - i) + 1; };
+
+        for (size_t c = 0; c < count; c += lanes) {
+            size_t n = std::min(lanes, count - c);
+            const Real* from = in + c * N;
+            Real* to = out + c * N;
+
+            if (!inverse) {
+                load(temp, N, n, [&](size_t l, size_t i) { return Complex(from[l * N + sample(i)], 0); });
+                dft(temp, temp + N, N, false);
+                for (size_t k = 0; k < N; k++) temp[k] = mul(temp[N + k], Real(2) * w[k]);
+                store(temp, N, n, [&](size_t l, size_t k, Complex v) { to[l * N + k] = v.real(); });
+            } else {
+                load(temp, N, n, [&](size_t l, size_t k) {
+                    const Real* X = from + l * N;
+                    return Complex(X[k], k ? -X[N - k] : 0) * std::conj(w[k]);
+                });
+                dft(temp, temp + N, N, true);
+                store(temp + N, N, n, [&](size_t l, size_t i, Complex v) { to[l * N + sample(i)] = v.real(); });
+            }
+        }
+    }
+};
@@ -0,0 +1,100 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+class ThreadPool;
+
+// gilbert order stored as the move between consecutive curve points, half a byte each,
+// plus the raster pixel at every checkpointEvery-th position. about half a byte per
+// pixel where a forward + inverse CurveTable costs 8 (16 with 64 bit indices).
+// curve position -> pixel decodes from the nearest checkpoint, pixel -> position is gilbidx
+class CompactCurve {
+public:
+    static constexpr uint64_t checkpointEvery = 256;
+    static constexpr uint8_t jumpCode = 15;
+
+    long width;
+    long height;
+
+    std::vector<uint8_t> steps;        // move from position i to i + 1, low nibble first
+    std::vector<uint64_t> checkpoints; // raster pixel at every checkpointEvery-th position
+    std::vector<std::pair<uint64_t, uint64_t>> jumps; // (position, pixel) reached by a non-neighbour move, sorted
+
+    static std::shared_ptr<const CompactCurve> get(long width, long height, ThreadPool* pool = nullptr);
+    static void cleanup();
+
+    uint64_t length() const { return (uint64_t)width * height; }
+    size_t bytes() const;
+
+    uint64_t pixelAt(uint64_t pos) const;
+    uint64_t positionOf(long x, long y) const;
+
+    // fn(pos, pixel) for every curve position in [begin, end), in order
+    template<typename F>
+    void walk(uint64_t begin, uint64_t end, F&& fn) const {
+        if (begin >= end) return;
+
+        uint64_t pos = begin - begin % checkpointEvery;
+        uint64_t pixel = checkpoints[pos / checkpointEvery];
+        for (; pos < begin; pos++) pixel = next(pos, pixel);
+
+        for (;;) {
+            fn(pos, pixel);
+            if (++pos == end) break;
+            pixel = next(pos - 1, pixel);
+        }
+    }
+
+    // raster pixels of curve positions [begin, begin + count) into out,
+    // a whole byte of moves per step once aligned
+    template<typename Index>
+    void decode(uint64_t begin, uint64_t count, Index* out) const {
+        if (count == 0) return;
+
+        uint64_t end = begin + count;
+        uint64_t pixel = pixelAt(begin);
+        out[0] = pixel;
+
+        uint64_t pos = begin + 1;
+        while (pos < end) {
+            if ((pos & 1) && pos + 1 < end) {
+                uint8_t b = steps[(pos - 1) >> 1];
+                if ((b & 0xf) != jumpCode && (b >> 4) != jumpCode) {
+                    pixel += delta[b & 0xf];
+                    out[pos - begin] = pixel;
+                    pixel += delta[b >> 4];
+                    out[pos + 1 - begin] = pixel;
+                    pos += 2;
+                    continue;
+                }
+            }
+
+            // unaligned ends and jumps go one move at a time
+            pixel = next(pos - 1, pixel);
+            out[pos - begin] = pixel;
+            pos++;
+        }
+    }
+
+private:
+    static std::map<std::pair<long, long>, std::shared_ptr<const CompactCurve>> curves;
+    static std::mutex curve_mutex;
+
+    int64_t delta[16]; // raster offset of each move code
+
+    // pixel at pos + 1 given the pixel at pos
+    uint64_t next(uint64_t pos, uint64_t pixel) const {
+        uint8_t code = (steps[pos >> 1] >> ((pos & 1) * 4)) & 0xf;
+        if (code != jumpCode) return pixel + delta[code];
+
+        auto it = std::lower_bound(jumps.begin(), jumps.end(), std::make_pair(pos + 1, uint64_t(0)));
+        return it->second;
+    }
+
+    void build(ThreadPool* pool);
+};
@@ -0,0 +1,152 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <hilbert.hpp>
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+// the pixel linearizations an image can be coded along
+enum class CurveKind {
+    Gilbert, // generalized hilbert, continuous on any rectangle
+    Hilbert, // power of two hilbert over the bounding square, outside points skipped
+    Morton,  // z-order over the bounding square, outside points skipped
+    Snake,   // rows, alternating direction
+};
+
+inline const char* curveName(CurveKind kind) {
+    switch (kind) {
+        case CurveKind::Gilbert: return "gilbert";
+        case CurveKind::Hilbert: return "hilbert";
+        case CurveKind::Morton: return "morton";
+        case CurveKind::Snake: return "snake";
+    }
+    return "?";
+}
+
+inline CurveKind curveFromName(const std::string& name) {
+    for (CurveKind kind : {CurveKind::Gilbert, CurveKind::Hilbert, CurveKind::Morton, CurveKind::Snake}) {
+        if (name == curveName(kind)) return kind;
+    }
+    throw std::invalid_argument("unknown curve: " + name);
+}
+
+inline uint64_t mortonEncode(uint64_t x, uint64_t y) {
+#ifdef __BMI2__
+    return _pdep_u64(x, 0x5555555555555555ull) | _pdep_u64(y, 0xaaaaaaaaaaaaaaaaull);
+#else
+    auto spread = [](uint64_t v) {
+        v &= 0xffffffffull;
+        v = (v | (v << 16)) & 0x0000ffff0000ffffull;
+        v = (v | (v << 8)) & 0x00ff00ff00ff00ffull;
+        v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0full;
+        v = (v | (v << 2)) & 0x3333333333333333ull;
+        v = (v | (v << 1)) & 0x5555555555555555ull;
+        return v;
+    };
+    return spread(x) | (spread(y) << 1);
+#endif
+}
+
+inline void mortonDecode(uint64_t index, long& x, long& y) {
+#ifdef __BMI2__
+    x = _pext_u64(index, 0x5555555555555555ull);
+    y = _pext_u64(index, 0xaaaaaaaaaaaaaaaaull);
+#else
+    auto compact = [](uint64_t v) {
+        v &= 0x5555555555555555ull;
+        v = (v | (v >> 1)) & 0x3333333333333333ull;
+        v = (v | (v >> 2)) & 0x0f0f0f0f0f0f0f0full;
+        v = (v | (v >> 4)) & 0x00ff00ff00ff00ffull;
+        v = (v | (v >> 8)) & 0x0000ffff0000ffffull;
+        v = (v | (v >> 16)) & 0x00000000ffffffffull;
+        return v;
+    };
+    x = compact(index);
+    y = compact(index >> 1);
+#endif
+}
+
+// sort key of (x, y) along the curve. gilbert and snake keys are the curve position itself,
+// hilbert and morton keys are positions on the bounding square, so they have gaps
+inline uint64_t curveKey(CurveKind kind, long x, long y, long width, long height) {
+    switch (kind) {
+        case CurveKind::Gilbert: return gilbidx(x, y, width, height);
+        case CurveKind::Hilbert: return hilbertEncode(x, y, std::bit_width((unsigned long)std::max(width, height) - 1));
+        case CurveKind::Morton: return mortonEncode(x, y);
+        case CurveKind::Snake: return (uint64_t)width * y + (y & 1 ? width - 1 - x : x);
+    }
+    return 0;
+}
+
+// walks a quadtree curve over the bounding power of two square. every aligned run of
+// 4^k indices is one 2^k square, so runs that miss the image are skipped whole and
+// only squares on the right or bottom edge are split further
+template<typename Decode, typename F>
+void forEachQuadtreePoint(long width, long height, Decode&& decode, F&& fn) {
+    int sidePow = std::bit_width((unsigned long)std::max(width, height) - 1);
+    uint64_t total = uint64_t(1) << (2 * sidePow);
+
+    for (uint64_t d = 0; d < total;) {
+        int k = d ? std::min(std::countr_zero(d) / 2, sidePow) : sidePow;
+        bool inside = false;
+
+        for (;; k--) {
+            long x, y;
+            decode(d, sidePow, x, y);
+            long x0 = x & ~((1L << k) - 1);
+            long y0 = y & ~((1L << k) - 1);
+            if (x0 >= width || y0 >= height) break;
+            if (k == 0 || (x0 + (1L << k) <= width && y0 + (1L << k) <= height)) {
+                inside = true;
+                break;
+            }
+        }
+
+        uint64_t run = uint64_t(1) << (2 * k);
+        if (inside) {
+            for (uint64_t i = d; i < d + run; i++) {
+                long x, y;
+                decode(i, sidePow, x, y);
+                fn(x, y);
+            }
+        }
+        d += run;
+    }
+}
+
+// fn(x, y) for every pixel, in curve order
+template<typename F>
+void forEachCurvePoint(CurveKind kind, long width, long height, F&& fn) {
+    switch (kind) {
+        case CurveKind::Gilbert:
+            for (auto [x, y] : GilbertCurve(width, height)) fn(x, y);
+            return;
+
+        case CurveKind::Hilbert:
+            forEachQuadtreePoint(width, height, [](uint64_t d, long sidePow, long& x, long& y) {
+                hilbertDecode(d, sidePow, x, y);
+            }, fn);
+            return;
+
+        case CurveKind::Morton:
+            forEachQuadtreePoint(width, height, [](uint64_t d, long, long& x, long& y) {
+                mortonDecode(d, x, y);
+            }, fn);
+            return;
+
+        case CurveKind::Snake:
+            for (long y = 0; y < height; y++) {
+                if (y & 1) {
+                    for (long x = width - 1; x >= 0; x--) fn(x, y);
+                } else {
+                    for (long x = 0; x < width; x++) fn(x, y);
+                }
+            }
+            return;
+    }
+}
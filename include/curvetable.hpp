@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <curves.hpp>
+
+class ThreadPool;
+
+// curve order of a width x height image, built once per size and curve and shared.
+// with a tile size the image is cut into tileSize squares, the tiles are visited
+// along a coarse curve and each tile is walked along its own curve.
+// Index is the table entry type: 32 bit covers up to 4G pixels, beyond that use 64 bit
+template<typename Index>
+class BasicCurveTable {
+public:
+    long width;
+    long height;
+    long tileSize; // 0 = one curve over the whole image
+    CurveKind kind;
+
+    std::vector<Index> forward; // raster pixel -> curve position
+    std::vector<Index> inverse; // curve position -> raster pixel
+
+    // curve position where each tile starts, in curve order, plus the total length.
+    // empty for an untiled table
+    std::vector<Index> tileStart;
+
+    // builds on the pool's workers when one is given
+    static std::shared_ptr<const BasicCurveTable> get(long width, long height, ThreadPool* pool = nullptr,
+                                                      long tileSize = 0, CurveKind kind = CurveKind::Gilbert);
+    static void setCacheDir(const std::string& dir); // empty disables the on-disk cache
+    static void cleanup();
+
+private:
+    struct Tile {
+        long x, y;
+        long w, h;
+    };
+
+    static std::map<std::tuple<long, long, long, CurveKind>, std::shared_ptr<const BasicCurveTable>> tables;
+    static std::mutex table_mutex;
+    static std::string cacheDir;
+
+    void build(ThreadPool* pool);
+    void buildTiled(ThreadPool* pool);
+    std::vector<Tile> layoutTiles();
+    void buildInverse();
+    bool load(const std::string& path);
+    void save(const std::string& path) const;
+};
+
+using CurveTable = BasicCurveTable<uint32_t>;
+using WideCurveTable = BasicCurveTable<uint64_t>;
+
+extern template class BasicCurveTable<uint32_t>;
+extern template class BasicCurveTable<uint64_t>;
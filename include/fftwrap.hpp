@@ -1,19 +1,251 @@
 #pragma once
+#if IMAGECOMPRESSION_FFTW
 #include <fftw3.h>
+#endif
+#include <builtinfft.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <complex>
+#include <functional>
+#include <map>
 #include <mutex>
-#include <unordered_map>
+#include <new>
+#include <string>
+#include <tuple>
+
+// how hard fftw searches for a fast plan: estimate guesses, measure and patient time
+// candidates (patient tries more), wisdom-only takes only plans the wisdom already has
+enum class FFTPlanning { Estimate, Measure, Patient, WisdomOnly };
+
+const char* fftPlanningName(FFTPlanning p);
+FFTPlanning fftPlanningFromName(const std::string& name);
+
+// what runs a transform: auto takes the built in kernels for the lengths they have and fftw
+// for the rest, fftw (default) and builtin take one for every length. builds without fftw
+// (IMAGECOMPRESSION_FFTW off) always run the built in code
+enum class FFTBackend { Auto, FFTW, Builtin };
+
+const char* fftBackendName(FFTBackend b);
+FFTBackend fftBackendFromName(const std::string& name);
+
+// plan cache counters, see BasicFFT::stats()
+struct FFTPlanStats {
+    uint64_t hits = 0;      // transforms that found their plan
+    uint64_t misses = 0;    // plans made
+    uint64_t evictions = 0; // plans dropped for the cache limits
+    std::chrono::nanoseconds planning{0}; // time spent making plans
+    size_t livePlans = 0;   // plans not yet destroyed, cached or still running
+    size_t cachedPlans = 0;
+    size_t cachedBytes = 0; // estimated, see Plan::bytes
+};
+
+// largest 2^a 3^b 5^c 7^d <= n, for n >= 1. fftw has codelets for these radices,
+// other prime factors take its much slower generic algorithms
+size_t fftSmoothLength(size_t n);
+
+// allocator on fftw_malloc, aligned for the widest simd fftw was built with. a plan keeps
+// its simd codelets only for arrays aligned like the ones it was planned on, so every
+// buffer a transform sees comes from here. without fftw it aligns to a cache line
+template<typename T>
+struct FFTAllocator {
+    using value_type = T;
+
+    FFTAllocator() = default;
+    template<typename U>
+    FFTAllocator(const FFTAllocator<U>&) noexcept {}
+
+#if IMAGECOMPRESSION_FFTW
+    T* allocate(size_t n) {
+        void* p = fftw_malloc(n * sizeof(T));
+        if (!p) throw std::bad_alloc();
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, size_t) noexcept { fftw_free(p); }
+#else
+    T* allocate(size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(64)));
+    }
+
+    void deallocate(T* p, size_t) noexcept { ::operator delete(p, std::align_val_t(64)); }
+#endif
+
+    template<typename U>
+    bool operator==(const FFTAllocator<U>&) const noexcept { return true; }
+};
+
+template<typename T>
+using FFTBuffer = std::vector<T, FFTAllocator<T>>;
+
+#if IMAGECOMPRESSION_FFTW
+
+// the fftw api of one precision: fftw_* for double, fftwf_* for float
+template<typename Real>
+struct FFTW;
+
+template<>
+struct FFTW<double> {
+    using plan = fftw_plan;
+    using complex = fftw_complex;
+
+    static constexpr auto plan_dft_1d = fftw_plan_dft_1d;
+    static constexpr auto plan_many_dft = fftw_plan_many_dft;
+    static constexpr auto plan_dft_r2c_1d = fftw_plan_dft_r2c_1d;
+    static constexpr auto plan_dft_c2r_1d = fftw_plan_dft_c2r_1d;
+    static constexpr auto plan_many_dft_r2c = fftw_plan_many_dft_r2c;
+    static constexpr auto plan_many_dft_c2r = fftw_plan_many_dft_c2r;
+    static constexpr auto plan_many_r2r = fftw_plan_many_r2r;
+    static constexpr auto execute_dft = fftw_execute_dft;
+    static constexpr auto execute_dft_r2c = fftw_execute_dft_r2c;
+    static constexpr auto execute_dft_c2r = fftw_execute_dft_c2r;
+    static constexpr auto execute_r2r = fftw_execute_r2r;
+    static constexpr auto destroy_plan = fftw_destroy_plan;
+    static constexpr auto print_plan = fftw_print_plan;
+    static constexpr auto import_wisdom_from_filename = fftw_import_wisdom_from_filename;
+    static constexpr auto export_wisdom_to_filename = fftw_export_wisdom_to_filename;
+    static constexpr auto alignment_of = fftw_alignment_of;
+};
+
+template<>
+struct FFTW<float> {
+    using plan = fftwf_plan;
+    using complex = fftwf_complex;
+
+    static constexpr auto plan_dft_1d = fftwf_plan_dft_1d;
+    static constexpr auto plan_many_dft = fftwf_plan_many_dft;
+    static constexpr auto plan_dft_r2c_1d = fftwf_plan_dft_r2c_1d;
+    static constexpr auto plan_dft_c2r_1d = fftwf_plan_dft_c2r_1d;
+    static constexpr auto plan_many_dft_r2c = fftwf_plan_many_dft_r2c;
+    static constexpr auto plan_many_dft_c2r = fftwf_plan_many_dft_c2r;
+    static constexpr auto plan_many_r2r = fftwf_plan_many_r2r;
+    static constexpr auto execute_dft = fftwf_execute_dft;
+    static constexpr auto execute_dft_r2c = fftwf_execute_dft_r2c;
+    static constexpr auto execute_dft_c2r = fftwf_execute_dft_c2r;
+    static constexpr auto execute_r2r = fftwf_execute_r2r;
+    static constexpr auto destroy_plan = fftwf_destroy_plan;
+    static constexpr auto print_plan = fftwf_print_plan;
+    static constexpr auto import_wisdom_from_filename = fftwf_import_wisdom_from_filename;
+    static constexpr auto export_wisdom_to_filename = fftwf_export_wisdom_to_filename;
+    static constexpr auto alignment_of = fftwf_alignment_of;
+};
+#endif
+
+// fftw plans and transforms in one precision. double and float are separate fftw
+// libraries with their own planner and wisdom, so each keeps its own state. lengths the
+// backend gives to the built in kernels skip all of that
+template<typename Real>
+class BasicFFT {
+public:
+    using Planning = FFTPlanning;
+    using Backend = FFTBackend;
+    using Complex = std::complex<Real>;
+    using Buffer = FFTBuffer<Complex>;
+    using RealBuffer = FFTBuffer<Real>;
 
-class FFT {
 private:
-    struct PlanPair;  // Forward declaration
-    static std::unordered_map<size_t, PlanPair> plans;
-    static std::mutex fftw_mutex;
-    
+    using Builtin = BuiltinFFT<Real>;
+
+    static std::atomic<Backend> backend;
+    static bool builtin(size_t N);
+
+#if IMAGECOMPRESSION_FFTW
+    using Api = FFTW<Real>;
+
+    struct Plan;  // Forward declaration
+    enum class Kind { Dft, RealDft, Dct };
+    using PlanKey = std::tuple<size_t, size_t, Kind>; // (N, count, kind)
+
+    // the cached plans, under fftw_mutex. hot path lookups go through a per thread index
+    // instead, see plan(). past the limits the least recently used plans are dropped
+    static std::map<PlanKey, std::shared_ptr<const Plan>> plans;
+    static std::atomic<uint64_t> generation; // bumped by cleanup(), empties the per thread indexes
+    static std::mutex fftw_mutex; // planning and plan destruction, fftw_execute needs no lock
+
+    static size_t maxPlans; // 0 = no limit
+    static size_t maxBytes;
+    static size_t cachedBytes;
+
+    static std::atomic<uint64_t> useClock; // orders plan uses for the lru
+    static std::atomic<uint64_t> hits, misses, evictions;
+    static std::atomic<int64_t> planningNanos;
+    static std::atomic<size_t> livePlans;
+
+    static Planning planning;
+    static std::string wisdomFile;
+    static bool wisdomChanged; // planned something the wisdom file lacks
+    static std::atomic<bool> verbose;
+
+    static std::shared_ptr<const Plan> plan(size_t N, size_t count, Kind kind);
+    static std::shared_ptr<const Plan> build(size_t N, size_t count, Kind kind);
+    static void evict(std::vector<std::shared_ptr<const Plan>>& dropped);
+    static typename Api::plan makePlan(const std::function<typename Api::plan(unsigned)>& make);
+    static void describe(typename Api::plan plan);
+#endif
+
 public:
+    static void setBackend(Backend b);
+    static void setPlanning(Planning p);
+    static void setVerbose(bool v); // print every new plan
+
+    // measured plans kept across runs: imports the file if it exists, saveWisdom() and
+    // cleanup() write it back when planning added anything. empty disables
+    static bool setWisdomFile(const std::string& path);
+    static void saveWisdom();
+
+    // cap on cached plans, by count and by estimated bytes, 0 for no limit. a batch
+    // process that sees many lengths then keeps only the ones it uses most recently
+    static void setCacheLimits(size_t plans, size_t bytes);
+    static FFTPlanStats stats();
+
+    // transforms plan on first use, init*() only warm the cache. any thread may call them
     static void init(size_t N);
-    static void forward(std::vector<std::complex<double>>& data);
-    static void backward(std::vector<std::complex<double>>& data);
+    static void forward(Buffer& data);
+    static void backward(Buffer& data);
+
+    // real signals keep only the non-negative half of their spectrum, N/2 + 1 bins
+    static void initReal(size_t N);
+    static void forward(const RealBuffer& in, Buffer& out);
+    static void backward(const Buffer& in, RealBuffer& out); // out.size() is N
+
+    // count transforms of length N stored back to back, one plan call for all of them.
+    // complex batches are N * count values in place, real ones pair N * count samples
+    // with count half spectra of N/2 + 1 bins. fftw runs those on r2c / c2r plans, the built
+    // in code packs them two to a complex transform
+    static void initMany(size_t N, size_t count);
+    static void forwardMany(Buffer& data, size_t N);
+    static void backwardMany(Buffer& data, size_t N);
+
+    static void initRealMany(size_t N, size_t count);
+    static void forwardMany(const RealBuffer& in, Buffer& out, size_t N);
+    static void backwardMany(const Buffer& in, RealBuffer& out, size_t N);
+
+    // the lowest K bins, K <= N / 2 + 1, of the half spectra of count real signals of N
+    // samples, count blocks of K in out. small K take direct sums, K * N multiply adds per
+    // signal, the rest a whole transform truncated
+    static void forwardLowMany(const RealBuffer& in, Buffer& out, size_t N, size_t K);
+
+    // the inverse of spectra zero padded to N, given only their bins bins. complex ones hold
+    // the low (bins + 1) / 2 frequencies then the negative ones, the layout of a length bins
+    // transform; real ones are the first bins of an N sample half spectrum. with N = r * P and
+    // the bins fitting P, the r interleaved output phases are r length P transforms of
+    // twiddled bins and the butterflies on the zeros never run. N itself is the plain one
+    static void backwardPrunedMany(const Buffer& in, Buffer& out, size_t N, size_t bins);
+    static void backwardPrunedMany(const Buffer& in, RealBuffer& out, size_t N, size_t bins);
+
+    // dct-ii (fftw's REDFT10) and its inverse the dct-iii (REDFT01) of count real signals of
+    // length N back to back, out of place. unnormalized, dctMany then idctMany scales by 2N
+    static void initDCTMany(size_t N, size_t count);
+    static void dctMany(const RealBuffer& in, RealBuffer& out, size_t N);
+    static void idctMany(const RealBuffer& in, RealBuffer& out, size_t N);
+
     static void cleanup();
-};
\ No newline at end of file
+};
+
+using FFT = BasicFFT<double>;
+using FFTF = BasicFFT<float>;
+
+extern template class BasicFFT<double>;
+extern template class BasicFFT<float>;
@@ -1,47 +1,128 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
+#include <iterator>
+#include <utility>
+#include <vector>
 
-long hilbidx(long index, long sidePow) {
-    long x = 0;
-    long y = 0;
-    long t = index;
-    long s = 1;
+// top-down hilbert state machine, one level per step:
+// state x quadrant digit -> x bit, y bit, next state
+constexpr unsigned char hilbertStep[4][4][3] = {
+    {{0, 0, 1}, {0, 1, 0}, {1, 1, 0}, {1, 0, 2}},
+    {{0, 0, 0}, {1, 0, 1}, {1, 1, 1}, {0, 1, 3}},
+    {{1, 1, 3}, {0, 1, 2}, {0, 0, 2}, {1, 0, 0}},
+    {{1, 1, 2}, {1, 0, 3}, {0, 0, 3}, {0, 1, 1}},
+};
 
-    for (long i = 0; i < sidePow; i++) {
-        long rx = 1 & (t / 2);
-        long ry = 1 & (t ^ rx);
+// the same machine four levels at a time: a byte of index <-> a nibble of x and y
+struct HilbertLut {
+    uint16_t decode[4][256]; // digits -> x | y << 4 | state << 8
+    uint16_t encode[4][256]; // x << 4 | y -> digits | state << 8
+};
 
-        if (ry == 0) {
-            if (rx == 1) {
-                x = s - 1 - x;
-                y =  s - 1 - y;
+constexpr HilbertLut makeHilbertLut() {
+    HilbertLut lut{};
+    for (int s = 0; s < 4; s++) {
+        for (int digits = 0; digits < 256; digits++) {
+            int state = s, x = 0, y = 0;
+            for (int level = 3; level >= 0; level--) {
+                int q = (digits >> (2 * level)) & 3;
+                x = (x << 1) | hilbertStep[state][q][0];
+                y = (y << 1) | hilbertStep[state][q][1];
+                state = hilbertStep[state][q][2];
             }
-
-            long temp = x;
-            x = y;
-            y = temp;
+            lut.decode[s][digits] = x | (y << 4) | (state << 8);
+            lut.encode[s][(x << 4) | y] = digits | (state << 8);
         }
+    }
+    return lut;
+}
+
+inline constexpr HilbertLut hilbertLut = makeHilbertLut();
+
+// sidePow is padded up to whole bytes of index. a leading zero digit flips
+// state 0 <-> 1 without moving, so the padding only decides the start state
+constexpr void hilbertDecode(uint64_t index, long sidePow, long& x, long& y) {
+    long pad = (4 - sidePow % 4) % 4;
+    int state = pad & 1;
+    x = 0;
+    y = 0;
+    for (long shift = sidePow + pad - 4; shift >= 0; shift -= 4) {
+        uint16_t e = hilbertLut.decode[state][(index >> (2 * shift)) & 0xff];
+        x = (x << 4) | (e & 0xf);
+        y = (y << 4) | ((e >> 4) & 0xf);
+        state = e >> 8;
+    }
+}
+
+constexpr uint64_t hilbertEncode(long x, long y, long sidePow) {
+    long pad = (4 - sidePow % 4) % 4;
+    int state = pad & 1;
+    uint64_t index = 0;
+    for (long shift = sidePow + pad - 4; shift >= 0; shift -= 4) {
+        uint16_t e = hilbertLut.encode[state][(((x >> shift) & 0xf) << 4) | ((y >> shift) & 0xf)];
+        index = (index << 8) | (e & 0xff);
+        state = e >> 8;
+    }
+    return index;
+}
+
+// gilbert order of a Side x Side tile, generated at compile time. on power of two
+// squares gilbert is plain hilbert, so this is just the decoder run ahead of time
+template<int Side>
+struct GilbertTile {
+    static_assert(std::has_single_bit(unsigned(Side)) && Side <= 256, "tile side must be a power of two up to 256");
+    static constexpr int side = Side;
+
+    uint32_t order[Side * Side]; // local pixel x + Side * y at each curve position
+};
+
+template<int Side>
+constexpr GilbertTile<Side> makeGilbertTile() {
+    GilbertTile<Side> tile{};
+    for (long i = 0; i < Side * Side; i++) {
+        long x = 0, y = 0;
+        hilbertDecode(i, std::countr_zero(unsigned(Side)), x, y);
+        tile.order[i] = x + Side * y;
+    }
+    return tile;
+}
 
-        x += s * rx;
-        y += s * ry;
-        t /= 4;
-        s *= 2;
+template<int Side>
+inline constexpr GilbertTile<Side> gilbertTile = makeGilbertTile<Side>();
+
+// fn(gilbertTile<side>) if side is one of the prebuilt tile sizes, false otherwise
+template<typename F>
+bool withGilbertTile(long side, F&& fn) {
+    switch (side) {
+        case 8: fn(gilbertTile<8>); return true;
+        case 16: fn(gilbertTile<16>); return true;
+        case 32: fn(gilbertTile<32>); return true;
+        case 64: fn(gilbertTile<64>); return true;
     }
+    return false;
+}
 
+inline long hilbidx(long index, long sidePow) {
+    long x, y;
+    hilbertDecode(index, sidePow, x, y);
     return x + (y << sidePow);
 }
 
-static int sign(int x) {
+inline constexpr long sign(long x) {
   if (x < 0) { return -1; }
   if (x > 0) { return  1; }
   return 0;
 }
 
-int in_bounds(int x,  int y,
-               int x_s,int y_s,
-               int ax, int ay,
-               int bx, int by) {
-    int dx, dy;
+inline long in_bounds(long x,  long y,
+               long x_s,long y_s,
+               long ax, long ay,
+               long bx, long by) {
+    long dx, dy;
 
     dx = ax + bx;
     dy = ay + by;
@@ -63,25 +144,25 @@ int in_bounds(int x,  int y,
     return 1;
 }
 
-int recgilbert(int cur_idx,
-                   int x_dst, int y_dst,
-                   int x, int y,
-                   int ax, int ay,
-                   int bx,int by ) {
+inline long recgilbert(long cur_idx,
+                   long x_dst, long y_dst,
+                   long x, long y,
+                   long ax, long ay,
+                   long bx,long by ) {
 
-    int width = std::abs(ax + ay);
-    int height = std::abs(bx + by);
+    long width = std::labs(ax + ay);
+    long height = std::labs(bx + by);
   
     // unit major direction
-    int dax = sign(ax);
-    int day = sign(ay);
+    long dax = sign(ax);
+    long day = sign(ay);
 
     // unit orthogonal direction
-    int dbx = sign(bx);
-    int dby = sign(by);
+    long dbx = sign(bx);
+    long dby = sign(by);
 
-    int dx = dax + dbx;
-    int dy = day + dby;
+    long dx = dax + dbx;
+    long dy = day + dby;
 
     if (height == 1) {
         if (dax == 0) return cur_idx + dy * (y_dst - y);
@@ -93,13 +174,13 @@ int recgilbert(int cur_idx,
         return cur_idx + dx * (x_dst - x);
     }
 
-    int ax2 = ax >> 1;
-    int ay2 = ay >> 1;
-    int bx2 = bx >> 1;
-    int by2 = by >> 1;
+    long ax2 = ax >> 1;
+    long ay2 = ay >> 1;
+    long bx2 = bx >> 1;
+    long by2 = by >> 1;
 
-    int w2 = abs(ax2 + ay2);
-    int h2 = abs(bx2 + by2);
+    long w2 = std::labs(ax2 + ay2);
+    long h2 = std::labs(bx2 + by2);
 
     if (2 * width > 3 * height) {
         if ((w2 & 1) && (width > 2)) {
@@ -111,7 +192,7 @@ int recgilbert(int cur_idx,
             return recgilbert(cur_idx, x_dst, y_dst, x, y, ax2, ay2, bx, by);
         }
 
-        cur_idx += abs((ax2 + ay2) * (bx + by));
+        cur_idx += std::labs((ax2 + ay2) * (bx + by));
         return recgilbert(cur_idx, x_dst, y_dst, x+ax2, y+ay2, ax-ax2, ay-ay2, bx, by);
     }
 
@@ -125,19 +206,350 @@ int recgilbert(int cur_idx,
     if (in_bounds(x_dst, y_dst, x, y, bx2, by2, ax2, ay2)) {
         return recgilbert(cur_idx, x_dst, y_dst, x, y, bx2, by2, ax2, ay2);
     }
-    cur_idx += abs((bx2 + by2) * (ax2 + ay2));
+    cur_idx += std::labs((bx2 + by2) * (ax2 + ay2));
 
     if (in_bounds(x_dst, y_dst, x+bx2, y+by2, ax, ay, bx-bx2, by-by2)) {
         return recgilbert(cur_idx, x_dst, y_dst, x+bx2, y+by2, ax, ay, bx-bx2, by-by2);
     }
-    cur_idx += abs((ax + ay) * (bx - bx2 + by - by2));
+    cur_idx += std::labs((ax + ay) * (bx - bx2 + by - by2));
 
     return recgilbert(cur_idx, x_dst, y_dst, x+ax-dax+bx2-dbx, y+ay-day+by2-dby, -bx2, -by2, -(ax-ax2), -(ay-ay2));
 }
 
-long gilbidx(long x, long y, long width, long height) {
+inline long gilbidx(long x, long y, long width, long height) {
+    // on power of two squares the generalized curve is exactly the hilbert curve
+    if (width == height && std::has_single_bit((unsigned long)width)) {
+        return hilbertEncode(x, y, std::countr_zero((unsigned long)width));
+    }
     if (width >= height) return recgilbert(0, x, y, 0, 0, width, 0, 0, height);
     else return recgilbert(0, x, y, 0, 0, 0, height, width, 0);
 }
 
+struct GilbertPoint {
+    long x;
+    long y;
+};
+
+// curve position -> (x, y), the inverse of gilbidx. descends into whichever piece of
+// the recursion holds the position, so O(log n) and no tables
+inline GilbertPoint gilbxy(long index, long width, long height) {
+    if (width == height && std::has_single_bit((unsigned long)width)) {
+        GilbertPoint p;
+        hilbertDecode(index, std::countr_zero((unsigned long)width), p.x, p.y);
+        return p;
+    }
+
+    long x = 0, y = 0;
+    long ax = width, ay = 0, bx = 0, by = height;
+    if (width < height) {
+        ax = 0; ay = height;
+        bx = width; by = 0;
+    }
+
+    for (;;) {
+        long w = std::labs(ax + ay);
+        long h = std::labs(bx + by);
+
+        long dax = sign(ax), day = sign(ay);
+        long dbx = sign(bx), dby = sign(by);
+
+        if (h == 1) return {x + index * dax, y + index * day};
+        if (w == 1) return {x + index * dbx, y + index * dby};
+
+        long ax2 = ax >> 1, ay2 = ay >> 1;
+        long bx2 = bx >> 1, by2 = by >> 1;
+
+        long w2 = std::labs(ax2 + ay2);
+        long h2 = std::labs(bx2 + by2);
+
+        if (2 * w > 3 * h) {
+            if ((w2 & 1) && (w > 2)) {
+                // prefer even steps
+                ax2 += dax;
+                ay2 += day;
+            }
+
+            long first = std::labs((ax2 + ay2) * (bx + by));
+            if (index < first) {
+                ax = ax2;
+                ay = ay2;
+            } else {
+                index -= first;
+                x += ax2;
+                y += ay2;
+                ax -= ax2;
+                ay -= ay2;
+            }
+            continue;
+        }
+
+        if ((h2 & 1) && (h > 2)) {
+            // prefer even steps
+            bx2 += dbx;
+            by2 += dby;
+        }
+
+        long first = std::labs((bx2 + by2) * (ax2 + ay2));
+        if (index < first) {
+            long nax = bx2, nay = by2;
+            bx = ax2;
+            by = ay2;
+            ax = nax;
+            ay = nay;
+            continue;
+        }
+        index -= first;
+
+        long second = std::labs((ax + ay) * (bx - bx2 + by - by2));
+        if (index < second) {
+            x += bx2;
+            y += by2;
+            bx -= bx2;
+            by -= by2;
+            continue;
+        }
+        index -= second;
+
+        x += (ax - dax) + (bx2 - dbx);
+        y += (ay - day) + (by2 - dby);
+        long nax = -bx2, nay = -by2;
+        bx = -(ax - ax2);
+        by = -(ay - ay2);
+        ax = nax;
+        ay = nay;
+    }
+}
+
+// one piece of the gilbert recursion for gilbertRanges: emits the curve ranges of the
+// piece at curve position `offset` that fall inside [x0, x1) x [y0, y1)
+inline void gilbertRangesRec(long offset, long x, long y, long ax, long ay, long bx, long by,
+                             long x0, long y0, long x1, long y1,
+                             std::vector<std::pair<long, long>>& out) {
+    long w = std::labs(ax + ay);
+    long h = std::labs(bx + by);
+
+    long dax = sign(ax), day = sign(ay);
+    long dbx = sign(bx), dby = sign(by);
+
+    // inclusive bounding box of the piece
+    long xlo = x + std::min(0L, ax - dax) + std::min(0L, bx - dbx);
+    long xhi = x + std::max(0L, ax - dax) + std::max(0L, bx - dbx);
+    long ylo = y + std::min(0L, ay - day) + std::min(0L, by - dby);
+    long yhi = y + std::max(0L, ay - day) + std::max(0L, by - dby);
+
+    if (xhi < x0 || xlo >= x1 || yhi < y0 || ylo >= y1) return;
+
+    auto emit = [&](long begin, long end) {
+        if (begin >= end) return;
+        if (!out.empty() && out.back().second == begin) out.back().second = end;
+        else out.emplace_back(begin, end);
+    };
+
+    if (xlo >= x0 && xhi < x1 && ylo >= y0 && yhi < y1) {
+        emit(offset, offset + w * h);
+        return;
+    }
+
+    if (h == 1 || w == 1) {
+        // a straight run: clip the steps along its one moving axis
+        long dx = h == 1 ? dax : dbx;
+        long dy = h == 1 ? day : dby;
+        long n = h == 1 ? w : h;
+        long lo = 0, hi = n;
+        auto clip = [&](long origin, long step, long from, long to) {
+            if (step > 0) {
+                lo = std::max(lo, from - origin);
+                hi = std::min(hi, to - origin);
+            } else if (step < 0) {
+                lo = std::max(lo, origin - to + 1);
+                hi = std::min(hi, origin - from + 1);
+            }
+        };
+        clip(x, dx, x0, x1);
+        clip(y, dy, y0, y1);
+        emit(offset + lo, offset + hi);
+        return;
+    }
+
+    long ax2 = ax >> 1, ay2 = ay >> 1;
+    long bx2 = bx >> 1, by2 = by >> 1;
+
+    long w2 = std::labs(ax2 + ay2);
+    long h2 = std::labs(bx2 + by2);
+
+    if (2 * w > 3 * h) {
+        if ((w2 & 1) && (w > 2)) {
+            // prefer even steps
+            ax2 += dax;
+            ay2 += day;
+        }
+
+        long first = std::labs((ax2 + ay2) * (bx + by));
+        gilbertRangesRec(offset, x, y, ax2, ay2, bx, by, x0, y0, x1, y1, out);
+        gilbertRangesRec(offset + first, x + ax2, y + ay2, ax - ax2, ay - ay2, bx, by, x0, y0, x1, y1, out);
+        return;
+    }
+
+    if ((h2 & 1) && (h > 2)) {
+        // prefer even steps
+        bx2 += dbx;
+        by2 += dby;
+    }
+
+    long first = std::labs((bx2 + by2) * (ax2 + ay2));
+    long second = std::labs((ax + ay) * (bx - bx2 + by - by2));
+    gilbertRangesRec(offset, x, y, bx2, by2, ax2, ay2, x0, y0, x1, y1, out);
+    gilbertRangesRec(offset + first, x + bx2, y + by2, ax, ay, bx - bx2, by - by2, x0, y0, x1, y1, out);
+    gilbertRangesRec(offset + first + second,
+                     x + (ax - dax) + (bx2 - dbx), y + (ay - day) + (by2 - dby),
+                     -bx2, -by2, -(ax - ax2), -(ay - ay2), x0, y0, x1, y1, out);
+}
+
+// curve ranges [begin, end) covering the pixels [x0, x1) x [y0, y1), sorted and merged.
+// pieces wholly inside or outside the rectangle stop the recursion, so the work follows
+// the rectangle's border rather than its area
+inline std::vector<std::pair<long, long>> gilbertRanges(long x0, long y0, long x1, long y1,
+                                                        long width, long height) {
+    std::vector<std::pair<long, long>> out;
+    x0 = std::max(x0, 0L);
+    y0 = std::max(y0, 0L);
+    x1 = std::min(x1, width);
+    y1 = std::min(y1, height);
+    if (x0 >= x1 || y0 >= y1) return out;
+
+    if (width >= height) gilbertRangesRec(0, 0, 0, width, 0, 0, height, x0, y0, x1, y1, out);
+    else gilbertRangesRec(0, 0, 0, 0, height, width, 0, x0, y0, x1, y1, out);
+    return out;
+}
+
+// walks the curve in order without recursion: for (auto [x, y] : GilbertCurve(w, h))
+// a [first, last) sub range starts straight at position `first` in O(log n)
+class GilbertCurve {
+public:
+    GilbertCurve(long width, long height)
+    : width(width), height(height), first(0), last(width * height) {}
+
+    GilbertCurve(long width, long height, long first, long last)
+    : width(width), height(height), first(first), last(last) {}
+
+    class iterator {
+    public:
+        using value_type = GilbertPoint;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+
+        iterator(long width, long height, long first, long last) : pos(first), last(last) {
+            if (width <= 0 || height <= 0 || first >= last) return;
+            stack.reserve(64);
+            if (width >= height) stack.push_back({0, 0, width, 0, 0, height});
+            else stack.push_back({0, 0, 0, height, width, 0});
+            advance(first);
+        }
+
+        GilbertPoint operator*() const { return {x, y}; }
+
+        // position along the curve of the current point
+        long index() const { return pos; }
+
+        iterator& operator++() {
+            pos++;
+            if (--remaining > 0) {
+                x += dx;
+                y += dy;
+            } else {
+                advance();
+            }
+            return *this;
+        }
+
+        void operator++(int) { ++*this; }
+
+        bool operator==(std::default_sentinel_t) const { return remaining == 0 || pos >= last; }
+
+    private:
+        struct Frame {
+            long x, y;
+            long ax, ay;
+            long bx, by;
+        };
+
+        std::vector<Frame> stack;
+        long x = 0, y = 0;
+        long dx = 0, dy = 0;
+        long remaining = 0;
+        long pos = 0;
+        long last = 0;
+
+        // pop frames until one is a straight run, pushing the pieces of the others
+        // in reverse so they come back out in curve order. the first `skip` points
+        // are stepped over, whole frames at a time, to start mid curve
+        void advance(long skip = 0) {
+            while (!stack.empty()) {
+                Frame f = stack.back();
+                stack.pop_back();
+
+                long w = std::labs(f.ax + f.ay);
+                long h = std::labs(f.bx + f.by);
+
+                if (skip >= w * h) {
+                    skip -= w * h;
+                    continue;
+                }
+
+                long dax = sign(f.ax), day = sign(f.ay);
+                long dbx = sign(f.bx), dby = sign(f.by);
+
+                if (h == 1 || w == 1) {
+                    dx = h == 1 ? dax : dbx;
+                    dy = h == 1 ? day : dby;
+                    x = f.x + skip * dx;
+                    y = f.y + skip * dy;
+                    remaining = (h == 1 ? w : h) - skip;
+                    return;
+                }
+
+                long ax2 = f.ax >> 1, ay2 = f.ay >> 1;
+                long bx2 = f.bx >> 1, by2 = f.by >> 1;
+
+                long w2 = std::labs(ax2 + ay2);
+                long h2 = std::labs(bx2 + by2);
+
+                if (2 * w > 3 * h) {
+                    if ((w2 & 1) && (w > 2)) {
+                        // prefer even steps
+                        ax2 += dax;
+                        ay2 += day;
+                    }
+                    stack.push_back({f.x + ax2, f.y + ay2, f.ax - ax2, f.ay - ay2, f.bx, f.by});
+                    stack.push_back({f.x, f.y, ax2, ay2, f.bx, f.by});
+                    continue;
+                }
+
+                if ((h2 & 1) && (h > 2)) {
+                    // prefer even steps
+                    bx2 += dbx;
+                    by2 += dby;
+                }
+
+                stack.push_back({f.x + (f.ax - dax) + (bx2 - dbx), f.y + (f.ay - day) + (by2 - dby),
+                                 -bx2, -by2, -(f.ax - ax2), -(f.ay - ay2)});
+                stack.push_back({f.x + bx2, f.y + by2, f.ax, f.ay, f.bx - bx2, f.by - by2});
+                stack.push_back({f.x, f.y, bx2, by2, ax2, ay2});
+            }
+            remaining = 0;
+        }
+    };
+
+    iterator begin() const { return iterator(width, height, first, last); }
+    std::default_sentinel_t end() const { return std::default_sentinel; }
+    long size() const { return last - first; }
+
+private:
+    long width;
+    long height;
+    long first;
+    long last;
+};
+
 // https://github.com/jakubcerveny/gilbert/blob/master/ports/gilbert.c
\ No newline at end of file
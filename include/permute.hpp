@@ -0,0 +1,191 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <immintrin.h>
+#include <type_traits>
+#include <vector>
+#include <hilbert.hpp>
+
+// pixel permutation kernels: dst pixel i = src pixel idx[i], for whole pixels of Channels bytes.
+// srcBytes bounds the source so the 4 byte vector gathers never read past its end.
+
+// how far ahead of the gather the table is read to prefetch source pixels
+constexpr size_t permutePrefetch = 64;
+
+template<int Channels, typename Index>
+inline void gatherPixelsScalar(unsigned char* dst, const unsigned char* src, const Index* idx,
+                               size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        const unsigned char* p = src + Channels * (size_t)idx[i];
+        for (int k = 0; k < Channels; k++) {
+            dst[Channels * i + k] = p[k];
+        }
+    }
+}
+
+// vector part of gatherPixels, returns how many pixels it did
+template<int Channels>
+inline size_t gatherPixelsVector(unsigned char* dst, const unsigned char* src, const uint32_t* idx,
+                                 size_t count, size_t srcBytes) {
+    size_t i = 0;
+
+    // gathers take signed 32 bit byte offsets, bigger sources (past 2GB) take the scalar loop
+    if (srcBytes < 4 || srcBytes > INT32_MAX) return 0;
+
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+    // highest pixel whose 4 byte load stays inside src
+    const __m512i limit = _mm512_set1_epi32((srcBytes - 4) / Channels);
+    // bytes 0 1 2 4 5 6 8 9 10 12 13 14 of every 128 bit lane
+    const __m512i pack3 = _mm512_setr4_epi32(0x04020100, 0x09080605, 0x0e0d0c0a, -1);
+    const __m512i join3 = _mm512_setr_epi32(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 0, 0, 0, 0);
+    const __m512i zero = _mm512_setzero_si512();
+
+    for (; i + 16 <= count; i += 16) {
+        if (i + permutePrefetch + 16 <= count) {
+            for (size_t p = 0; p < 16; p += 4) {
+                _mm_prefetch((const char*)(src + Channels * (size_t)idx[i + permutePrefetch + p]), _MM_HINT_T0);
+            }
+        }
+
+        __m512i id = _mm512_loadu_si512(idx + i);
+        __mmask16 ok = _mm512_cmple_epu32_mask(id, limit);
+        __m512i px;
+        if constexpr (Channels == 4) {
+            px = _mm512_mask_i32gather_epi32(zero, 0xffff, id, (const int*)src, 4);
+        } else {
+            __m512i off = Channels == 3 ? _mm512_add_epi32(id, _mm512_add_epi32(id, id)) : id;
+            px = _mm512_mask_i32gather_epi32(zero, ok, off, (const int*)src, 1);
+        }
+
+        if constexpr (Channels == 1) {
+            _mm_storeu_si128((__m128i*)(dst + i), _mm512_maskz_cvtepi32_epi8(0xffff, px));
+        } else if constexpr (Channels == 3) {
+            px = _mm512_maskz_permutexvar_epi32(0x0fff, join3, _mm512_shuffle_epi8(px, pack3));
+            _mm512_mask_storeu_epi32(dst + 3 * i, 0x0fff, px);
+        } else {
+            _mm512_storeu_si512(dst + 4 * i, px);
+        }
+
+        // the last pixels of src were masked out of the gather
+        if (Channels != 4 && ok != 0xffff) {
+            gatherPixelsScalar<Channels>(dst, src, idx, i, i + 16);
+        }
+    }
+#elif defined(__AVX2__)
+    const __m256i limit = _mm256_set1_epi32((srcBytes - 4) / Channels);
+    const __m256i pack1 = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                           0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i pack3 = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                           0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const __m256i join1 = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+    const __m256i join3 = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 0, 0);
+    const __m256i bias = _mm256_set1_epi32(INT32_MIN);
+
+    for (; i + 8 <= count; i += 8) {
+        if (i + permutePrefetch + 8 <= count) {
+            _mm_prefetch((const char*)(src + Channels * (size_t)idx[i + permutePrefetch]), _MM_HINT_T0);
+            _mm_prefetch((const char*)(src + Channels * (size_t)idx[i + permutePrefetch + 4]), _MM_HINT_T0);
+        }
+
+        __m256i id = _mm256_loadu_si256((const __m256i*)(idx + i));
+        // unsigned id <= safe, via a signed compare on biased values
+        __m256i ok = _mm256_cmpgt_epi32(_mm256_xor_si256(id, bias), _mm256_xor_si256(limit, bias));
+        ok = _mm256_xor_si256(ok, _mm256_set1_epi32(-1));
+        __m256i px;
+        if constexpr (Channels == 4) {
+            px = _mm256_i32gather_epi32((const int*)src, id, 4);
+        } else {
+            __m256i off = Channels == 3 ? _mm256_add_epi32(id, _mm256_add_epi32(id, id)) : id;
+            px = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int*)src, off, ok, 1);
+        }
+
+        if constexpr (Channels == 1) {
+            px = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(px, pack1), join1);
+            _mm_storel_epi64((__m128i*)(dst + i), _mm256_castsi256_si128(px));
+        } else if constexpr (Channels == 3) {
+            px = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(px, pack3), join3);
+            _mm_storeu_si128((__m128i*)(dst + 3 * i), _mm256_castsi256_si128(px));
+            _mm_storel_epi64((__m128i*)(dst + 3 * i + 16), _mm256_extracti128_si256(px, 1));
+        } else {
+            _mm256_storeu_si256((__m256i*)(dst + 4 * i), px);
+        }
+
+        if (Channels != 4 && _mm256_movemask_ps(_mm256_castsi256_ps(ok)) != 0xff) {
+            gatherPixelsScalar<Channels>(dst, src, idx, i, i + 8);
+        }
+    }
+#else
+    (void)dst; (void)src; (void)idx; (void)count;
+#endif
+
+    return i;
+}
+
+template<int Channels, typename Index>
+inline void gatherPixels(unsigned char* dst, const unsigned char* src, const Index* idx,
+                         size_t count, size_t srcBytes) {
+    static_assert(Channels == 1 || Channels == 3 || Channels == 4, "gatherPixels: 1, 3 or 4 channels");
+
+    size_t i = 0;
+    if constexpr (std::is_same_v<Index, uint32_t>) {
+        i = gatherPixelsVector<Channels>(dst, src, idx, count, srcBytes);
+    }
+
+    gatherPixelsScalar<Channels>(dst, src, idx, i, count);
+}
+
+// runtime channel count, for callers that only know it after loading
+template<typename Index>
+inline void gatherPixels(unsigned char* dst, const unsigned char* src, const Index* idx,
+                         size_t count, size_t srcBytes, int channels) {
+    switch (channels) {
+        case 1: return gatherPixels<1>(dst, src, idx, count, srcBytes);
+        case 3: return gatherPixels<3>(dst, src, idx, count, srcBytes);
+        case 4: return gatherPixels<4>(dst, src, idx, count, srcBytes);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        for (int k = 0; k < channels; k++) {
+            dst[channels * i + k] = src[channels * (size_t)idx[i] + k];
+        }
+    }
+}
+
+// the inverse move, dst pixel idx[i] = src pixel i. stores cannot be gathered, so this
+// stays scalar with the pixel size fixed at compile time
+template<int Channels, typename Index>
+inline void scatterPixels(unsigned char* dst, const unsigned char* src, const Index* idx, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        unsigned char* p = dst + Channels * (size_t)idx[i];
+        for (int k = 0; k < Channels; k++) {
+            p[k] = src[Channels * i + k];
+        }
+    }
+}
+
+template<typename Index>
+inline void scatterPixels(unsigned char* dst, const unsigned char* src, const Index* idx,
+                          size_t count, int channels) {
+    switch (channels) {
+        case 1: return scatterPixels<1>(dst, src, idx, count);
+        case 3: return scatterPixels<3>(dst, src, idx, count);
+        case 4: return scatterPixels<4>(dst, src, idx, count);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        for (int k = 0; k < channels; k++) {
+            dst[channels * (size_t)idx[i] + k] = src[channels * i + k];
+        }
+    }
+}
+
+// pixel offsets of a tile's curve order from its top left pixel, in an image stride pixels
+// wide. whole tiles then run through the gather kernel with an index table that stays in L1
+template<int Side>
+inline std::vector<uint32_t> tileOffsets(const GilbertTile<Side>& tile, size_t stride) {
+    std::vector<uint32_t> offsets(Side * Side);
+    for (int i = 0; i < Side * Side; i++) {
+        offsets[i] = tile.order[i] % Side + stride * (tile.order[i] / Side);
+    }
+    return offsets;
+}
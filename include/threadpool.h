@@ -1,5 +1,8 @@
+#pragma once
+#include <algorithm>
 #include <atomic>
 #include <condition_variable>
+#include <exception>
 #include <functional>
 #include <future>
 #include <iostream>
@@ -54,6 +57,41 @@ public:
         return future;
     }
 
+    // splits [0, count) into one contiguous range per worker and blocks until all are done.
+    // must not be called from inside a pool task
+    template<typename F>
+    void parallelFor(size_t count, F&& f, size_t minChunk = 1) {
+        size_t chunks = std::min(threads.size(), (count + minChunk - 1) / std::max<size_t>(minChunk, 1));
+        if (chunks <= 1) {
+            f(size_t(0), count);
+            return;
+        }
+
+        // the chunks hold f by reference, so every queued one has to finish before the first
+        // exception, from a chunk or from queueing them, leaves this frame
+        std::exception_ptr error;
+        std::vector<std::future<void>> futures;
+        futures.reserve(chunks);
+        try {
+            for (size_t c = 0; c < chunks; c++) {
+                size_t begin = count * c / chunks;
+                size_t end = count * (c + 1) / chunks;
+                futures.push_back(addTask([&f, begin, end]() { f(begin, end); }));
+            }
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        for (auto& future : futures) {
+            try {
+                future.get();
+            } catch (...) {
+                if (!error) error = std::current_exception();
+            }
+        }
+        if (error) std::rethrow_exception(error);
+    }
+
     void shutdown() {
         {
             std::lock_guard<std::mutex> lock(mutex);
@@ -0,0 +1,106 @@
+#include <compactcurve.hpp>
+#include <hilbert.hpp>
+#include <threadpool.h>
+#include <stdexcept>
+
+namespace {
+    // move codes 0..7: the eight neighbours, row by row, skipping the centre
+    int moveCode(long dx, long dy) {
+        if (dx < -1 || dx > 1 || dy < -1 || dy > 1 || (dx == 0 && dy == 0)) return CompactCurve::jumpCode;
+        int code = (dy + 1) * 3 + (dx + 1);
+        return code > 4 ? code - 1 : code;
+    }
+}
+
+std::map<std::pair<long, long>, std::shared_ptr<const CompactCurve>> CompactCurve::curves;
+std::mutex CompactCurve::curve_mutex;
+
+std::shared_ptr<const CompactCurve> CompactCurve::get(long width, long height, ThreadPool* pool) {
+    if (width <= 0 || height <= 0) {
+        throw std::out_of_range("CompactCurve::get: invalid size");
+    }
+
+    auto key = std::make_pair(width, height);
+    {
+        std::lock_guard<std::mutex> lock(curve_mutex);
+        auto it = curves.find(key);
+        if (it != curves.end()) {
+            return it->second;
+        }
+    }
+
+    auto curve = std::make_shared<CompactCurve>();
+    curve->width = width;
+    curve->height = height;
+    curve->build(pool);
+
+    std::lock_guard<std::mutex> lock(curve_mutex);
+    return curves.emplace(key, curve).first->second;
+}
+
+void CompactCurve::cleanup() {
+    std::lock_guard<std::mutex> lock(curve_mutex);
+    curves.clear();
+}
+
+size_t CompactCurve::bytes() const {
+    return steps.size() + checkpoints.size() * sizeof(uint64_t) + jumps.size() * sizeof(jumps[0]);
+}
+
+uint64_t CompactCurve::pixelAt(uint64_t pos) const {
+    uint64_t pixel = 0;
+    walk(pos, pos + 1, [&](uint64_t, uint64_t p) { pixel = p; });
+    return pixel;
+}
+
+uint64_t CompactCurve::positionOf(long x, long y) const {
+    return gilbidx(x, y, width, height);
+}
+
+void CompactCurve::build(ThreadPool* pool) {
+    for (long dy = -1; dy <= 1; dy++) {
+        for (long dx = -1; dx <= 1; dx++) {
+            int code = moveCode(dx, dy);
+            if (code != jumpCode) delta[code] = dx + width * dy;
+        }
+    }
+    delta[jumpCode] = 0;
+
+    uint64_t n = length();
+    uint64_t blocks = (n + checkpointEvery - 1) / checkpointEvery;
+    steps.assign((n + 1) / 2, 0);
+    checkpoints.resize(blocks);
+
+    // every block of checkpointEvery positions owns whole bytes of steps, so blocks
+    // can be encoded independently. each walks one point into the next block for its last move
+    std::mutex jumpMutex;
+    auto encode = [&](size_t first, size_t last) {
+        uint64_t begin = first * checkpointEvery;
+        uint64_t end = std::min(n, last * checkpointEvery + 1);
+
+        long px = 0, py = 0;
+        uint64_t pos = begin;
+        for (auto [x, y] : GilbertCurve(width, height, begin, end)) {
+            if (pos % checkpointEvery == 0 && pos / checkpointEvery < last) {
+                checkpoints[pos / checkpointEvery] = x + (uint64_t)width * y;
+            }
+            if (pos > begin) {
+                uint64_t at = pos - 1;
+                int code = moveCode(x - px, y - py);
+                steps[at >> 1] |= code << ((at & 1) * 4);
+                if (code == jumpCode) {
+                    std::lock_guard<std::mutex> lock(jumpMutex);
+                    jumps.emplace_back(pos, x + (uint64_t)width * y);
+                }
+            }
+            px = x;
+            py = y;
+            pos++;
+        }
+    };
+
+    if (pool) pool->parallelFor(blocks, encode, 256);
+    else encode(0, blocks);
+
+    std::sort(jumps.begin(), jumps.end());
+}
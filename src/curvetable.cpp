@@ -0,0 +1,274 @@
+#include <curvetable.hpp>
+#include <hilbert.hpp>
+#include <threadpool.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+    struct CacheHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t width;
+        uint64_t height;
+        uint64_t tileSize;
+        uint64_t kind;
+    };
+
+    constexpr char cacheMagic[4] = {'G', 'I', 'L', 'B'};
+    constexpr uint32_t cacheVersion = 3;
+}
+
+template<typename Index>
+std::map<std::tuple<long, long, long, CurveKind>, std::shared_ptr<const BasicCurveTable<Index>>> BasicCurveTable<Index>::tables;
+template<typename Index>
+std::mutex BasicCurveTable<Index>::table_mutex;
+template<typename Index>
+std::string BasicCurveTable<Index>::cacheDir;
+
+template<typename Index>
+std::shared_ptr<const BasicCurveTable<Index>> BasicCurveTable<Index>::get(long width, long height, ThreadPool* pool,
+                                                                          long tileSize, CurveKind kind) {
+    if (width <= 0 || height <= 0 || tileSize < 0) {
+        throw std::out_of_range("CurveTable::get: invalid size");
+    }
+    if ((uint64_t)width * (uint64_t)height - 1 > std::numeric_limits<Index>::max()) {
+        throw std::out_of_range("CurveTable::get: image too large for the index type, use WideCurveTable");
+    }
+
+    // a single tile covering the image is just the untiled curve
+    if (tileSize >= width && tileSize >= height) tileSize = 0;
+
+    auto key = std::make_tuple(width, height, tileSize, kind);
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(table_mutex);
+
+        auto it = tables.find(key);
+        if (it != tables.end()) {
+            return it->second;
+        }
+
+        if (!cacheDir.empty()) {
+            path = cacheDir + "/" + curveName(kind) + std::to_string(8 * sizeof(Index)) + "_" + std::to_string(width) + "x" + std::to_string(height);
+            if (tileSize) path += "_t" + std::to_string(tileSize);
+            path += ".bin";
+        }
+    }
+
+    // built outside the lock: other sizes stay available meanwhile and a tiled
+    // table can fetch its per-tile table through get()
+    auto table = std::make_shared<BasicCurveTable>();
+    table->width = width;
+    table->height = height;
+    table->tileSize = tileSize;
+    table->kind = kind;
+
+    if (path.empty() || !table->load(path)) {
+        table->build(pool);
+        if (!path.empty()) table->save(path);
+    }
+
+    // if another thread built the same table first, keep theirs
+    std::lock_guard<std::mutex> lock(table_mutex);
+    return tables.emplace(key, table).first->second;
+}
+
+template<typename Index>
+void BasicCurveTable<Index>::setCacheDir(const std::string& dir) {
+    std::lock_guard<std::mutex> lock(table_mutex);
+    cacheDir = dir;
+}
+
+template<typename Index>
+void BasicCurveTable<Index>::cleanup() {
+    std::lock_guard<std::mutex> lock(table_mutex);
+    tables.clear();
+}
+
+template<typename Index>
+void BasicCurveTable<Index>::build(ThreadPool* pool) {
+    if (tileSize) {
+        buildTiled(pool);
+        return;
+    }
+
+    size_t length = width * height;
+    forward.resize(length);
+    inverse.resize(length);
+
+    // one sequential walk of the curve fills both directions
+    if (kind != CurveKind::Gilbert) {
+        Index pos = 0;
+        forEachCurvePoint(kind, width, height, [&](long x, long y) {
+            Index pixel = x + width * y;
+            inverse[pos] = pixel;
+            forward[pixel] = pos;
+            pos++;
+        });
+        return;
+    }
+
+    // only the gilbert walk can start mid curve, so only it is split across the pool
+    auto walk = [this](size_t begin, size_t end) {
+        Index pos = begin;
+        for (auto [x, y] : GilbertCurve(width, height, begin, end)) {
+            Index pixel = x + width * y;
+            inverse[pos] = pixel;
+            forward[pixel] = pos;
+            pos++;
+        }
+    };
+
+    if (pool) pool->parallelFor(length, walk, 1 << 16);
+    else walk(0, length);
+}
+
+template<typename Index>
+std::vector<typename BasicCurveTable<Index>::Tile> BasicCurveTable<Index>::layoutTiles() {
+    long tilesX = (width + tileSize - 1) / tileSize;
+    long tilesY = (height + tileSize - 1) / tileSize;
+
+    std::vector<Tile> tiles;
+    tiles.reserve(tilesX * tilesY);
+    tileStart.clear();
+    tileStart.reserve(tilesX * tilesY + 1);
+
+    Index pos = 0;
+    forEachCurvePoint(kind, tilesX, tilesY, [&](long tx, long ty) {
+        Tile tile;
+        tile.x = tx * tileSize;
+        tile.y = ty * tileSize;
+        tile.w = std::min(tileSize, width - tile.x);
+        tile.h = std::min(tileSize, height - tile.y);
+        tiles.push_back(tile);
+        tileStart.push_back(pos);
+        pos += tile.w * tile.h;
+    });
+    tileStart.push_back(pos);
+
+    return tiles;
+}
+
+template<typename Index>
+void BasicCurveTable<Index>::buildTiled(ThreadPool* pool) {
+    std::vector<Tile> tiles = layoutTiles();
+
+    size_t length = width * height;
+    forward.resize(length);
+    inverse.resize(length);
+
+    // every whole tile shares one tileSize x tileSize order, only edge tiles walk their own curve.
+    // gilbert and hilbert tiles of the common sizes take it from the compile time tables
+    std::vector<Index> whole;
+    bool prebuilt = (kind == CurveKind::Gilbert || kind == CurveKind::Hilbert)
+        && withGilbertTile(tileSize, [&](const auto& tile) {
+            whole.assign(std::begin(tile.order), std::end(tile.order));
+        });
+    if (!prebuilt) whole = get(tileSize, tileSize, nullptr, 0, kind)->inverse;
+
+    auto fill = [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; t++) {
+            const Tile& tile = tiles[t];
+            Index pos = tileStart[t];
+
+            auto place = [&](long x, long y) {
+                Index pixel = (tile.x + x) + width * (tile.y + y);
+                inverse[pos] = pixel;
+                forward[pixel] = pos;
+                pos++;
+            };
+
+            if (tile.w == tileSize && tile.h == tileSize) {
+                for (Index local : whole) place(local % tileSize, local / tileSize);
+            } else {
+                forEachCurvePoint(kind, tile.w, tile.h, place);
+            }
+        }
+    };
+
+    if (pool) pool->parallelFor(tiles.size(), fill, 16);
+    else fill(0, tiles.size());
+}
+
+template<typename Index>
+void BasicCurveTable<Index>::buildInverse() {
+    inverse.resize(forward.size());
+    for (size_t i = 0; i < forward.size(); i++) {
+        inverse[forward[i]] = i;
+    }
+}
+
+template<typename Index>
+bool BasicCurveTable<Index>::load(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+
+    CacheHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in
+        || memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0
+        || header.version != cacheVersion
+        || header.width != (uint64_t)width
+        || header.height != (uint64_t)height
+        || header.tileSize != (uint64_t)tileSize
+        || header.kind != (uint64_t)kind) {
+        return false;
+    }
+
+    size_t length = width * height;
+    forward.resize(length);
+    in.read(reinterpret_cast<char*>(forward.data()), length * sizeof(Index));
+    if (!in) return false;
+
+    // reject anything that is not a permutation, a stale file must never corrupt output
+    std::vector<bool> seen(length, false);
+    for (Index pos : forward) {
+        if (pos >= length || seen[pos]) return false;
+        seen[pos] = true;
+    }
+
+    buildInverse();
+    if (tileSize) layoutTiles();
+    return true;
+}
+
+template<typename Index>
+void BasicCurveTable<Index>::save(const std::string& path) const {
+    // write beside the target and rename so concurrent readers never see a partial file
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cout << "could not write curve cache " << path << "\n";
+            return;
+        }
+
+        CacheHeader header;
+        memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+        header.version = cacheVersion;
+        header.width = width;
+        header.height = height;
+        header.tileSize = tileSize;
+        header.kind = (uint64_t)kind;
+
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(forward.data()), forward.size() * sizeof(Index));
+        if (!out) {
+            std::cout << "could not write curve cache " << path << "\n";
+            return;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) std::remove(tmp.c_str());
+}
+
+template class BasicCurveTable<uint32_t>;
+template class BasicCurveTable<uint64_t>;
@@ -1,79 +1,762 @@
-#include <fftw3.h>
 #include <fftwrap.hpp>
+#include <algorithm>
+#include <bit>
 #include <cassert>
+#include <cstdio>
+#include <filesystem>
 #include <iostream>
-#include <unordered_map>
+#include <stdexcept>
 
-struct FFT::PlanPair {
-    fftw_plan forward;
-    fftw_plan backward;
+const char* fftPlanningName(FFTPlanning p) {
+    switch (p) {
+        case FFTPlanning::Estimate: return "estimate";
+        case FFTPlanning::Measure: return "measure";
+        case FFTPlanning::Patient: return "patient";
+        case FFTPlanning::WisdomOnly: return "wisdom-only";
+    }
+    return "?";
+}
+
+FFTPlanning fftPlanningFromName(const std::string& name) {
+    for (FFTPlanning p : {FFTPlanning::Estimate, FFTPlanning::Measure, FFTPlanning::Patient, FFTPlanning::WisdomOnly}) {
+        if (name == fftPlanningName(p)) return p;
+    }
+    throw std::invalid_argument("unknown fft planning: " + name);
+}
+
+const char* fftBackendName(FFTBackend b) {
+    switch (b) {
+        case FFTBackend::Auto: return "auto";
+        case FFTBackend::FFTW: return "fftw";
+        case FFTBackend::Builtin: return "builtin";
+    }
+    return "?";
+}
+
+FFTBackend fftBackendFromName(const std::string& name) {
+    for (FFTBackend b : {FFTBackend::Auto, FFTBackend::FFTW, FFTBackend::Builtin}) {
+        if (name == fftBackendName(b)) return b;
+    }
+    throw std::invalid_argument("unknown fft backend: " + name);
+}
+
+size_t fftSmoothLength(size_t n) {
+    size_t best = 1;
+    for (size_t a = 1; a <= n; a *= 2) {
+        for (size_t b = a; b <= n; b *= 3) {
+            for (size_t c = b; c <= n; c *= 5) {
+                for (size_t d = c; d <= n; d *= 7) best = std::max(best, d);
+            }
+        }
+    }
+    return best;
+}
+
+// pruning trades the butterflies on zeros for a twiddle pass and an interleave of the phases,
+// which only pays once most of the spectrum is zeros and the transforms are long. measured
+// with fftw: even at r = 4, 10-35% faster from r = 16 and N = 256, slower below either
+constexpr size_t minPrunedRatio = 16;
+constexpr size_t minPrunedLength = 256;
+
+// length of the sub transforms of a pruned inverse: the smallest divisor of N that is at
+// least least, or N where pruning would not pay
+static size_t prunedLength(size_t N, size_t least) {
+    if (N < minPrunedLength) return N;
+    for (size_t p = std::max<size_t>(least, 1); p * minPrunedRatio <= N; p++) {
+        if (N % p == 0) return p;
+    }
+    return N;
+}
+
+// twiddles of the phases of a pruned inverse, phase s at s * P: e^(2 pi i k s / N) for the
+// bins k = 0 .. low - 1 at the front of the length P spectra and k = -high .. -1 at the
+// back, zero between. w are the roots of N, k * s steps through them s at a time
+template<typename Complex>
+static void prunedTwiddles(FFTBuffer<Complex>& tw, const Complex* w, size_t N, size_t P, size_t low, size_t high) {
+    tw.assign(N, Complex(0, 0));
+    for (size_t s = 0; s < N / P; s++) {
+        Complex* t = tw.data() + s * P;
+        for (size_t i = 0, k = 0; i < low; i++, k = k + s < N ? k + s : k + s - N) t[i] = w[k];
+        for (size_t i = 1, k = s; i <= high; i++, k = k + s < N ? k + s : k + s - N) t[P - i] = std::conj(w[k]);
+    }
+}
+
+#if IMAGECOMPRESSION_FFTW
+// plans are made on fftw_malloc'd arrays, so they assume simd alignment. FFTBuffer always
+// has it, anything else would run misaligned codelets
+template<typename Real>
+static bool simdAligned(const void* p) {
+    return FFTW<Real>::alignment_of(static_cast<Real*>(const_cast<void*>(p))) == 0;
+}
+
+// destroying a plan is planner work too, so it takes the lock like making one
+template<typename Real>
+struct BasicFFT<Real>::Plan {
+    typename Api::plan forward = nullptr;
+    typename Api::plan backward = nullptr;
+
+    // fftw does not report plan sizes, this counts the twiddle tables of both directions
+    size_t bytes = 0;
+    mutable std::atomic<uint64_t> lastUse{0};
+
+    Plan() {
+        livePlans.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ~Plan() {
+        std::lock_guard<std::mutex> lock(fftw_mutex);
+        if (forward) Api::destroy_plan(forward);
+        if (backward) Api::destroy_plan(backward);
+        livePlans.fetch_sub(1, std::memory_order_relaxed);
+    }
 };
 
-std::unordered_map<size_t, FFT::PlanPair> FFT::plans;
-std::mutex FFT::fftw_mutex;
+// defined first so it outlives the plans destroyed at exit
+template<typename Real>
+std::mutex BasicFFT<Real>::fftw_mutex;
+template<typename Real>
+std::map<typename BasicFFT<Real>::PlanKey, std::shared_ptr<const typename BasicFFT<Real>::Plan>> BasicFFT<Real>::plans;
+template<typename Real>
+std::atomic<uint64_t> BasicFFT<Real>::generation{0};
+template<typename Real>
+FFTPlanning BasicFFT<Real>::planning = FFTPlanning::Estimate;
+template<typename Real>
+std::string BasicFFT<Real>::wisdomFile;
+template<typename Real>
+bool BasicFFT<Real>::wisdomChanged = false;
+template<typename Real>
+std::atomic<bool> BasicFFT<Real>::verbose{false};
+template<typename Real>
+size_t BasicFFT<Real>::maxPlans = 0;
+template<typename Real>
+size_t BasicFFT<Real>::maxBytes = 0;
+template<typename Real>
+size_t BasicFFT<Real>::cachedBytes = 0;
+template<typename Real>
+std::atomic<uint64_t> BasicFFT<Real>::useClock{0};
+template<typename Real>
+std::atomic<uint64_t> BasicFFT<Real>::hits{0};
+template<typename Real>
+std::atomic<uint64_t> BasicFFT<Real>::misses{0};
+template<typename Real>
+std::atomic<uint64_t> BasicFFT<Real>::evictions{0};
+template<typename Real>
+std::atomic<int64_t> BasicFFT<Real>::planningNanos{0};
+template<typename Real>
+std::atomic<size_t> BasicFFT<Real>::livePlans{0};
+
+
+template<typename Real>
+void BasicFFT<Real>::setPlanning(Planning p) {
+    std::lock_guard<std::mutex> lock(fftw_mutex);
+    planning = p;
+}
+
+template<typename Real>
+void BasicFFT<Real>::setVerbose(bool v) {
+    verbose.store(v, std::memory_order_relaxed);
+}
+
+template<typename Real>
+bool BasicFFT<Real>::setWisdomFile(const std::string& path) {
+    std::lock_guard<std::mutex> lock(fftw_mutex);
+    wisdomFile = path;
+    wisdomChanged = false;
+    if (path.empty() || !std::filesystem::exists(path)) return false;
+
+    if (!Api::import_wisdom_from_filename(path.c_str())) {
+        std::cout << "could not read fft wisdom " << path << "\n";
+        return false;
+    }
+    return true;
+}
 
-void FFT::init(size_t N) {
+template<typename Real>
+void BasicFFT<Real>::setCacheLimits(size_t plans, size_t bytes) {
+    std::vector<std::shared_ptr<const Plan>> dropped; // destroyed after the lock is released
     std::lock_guard<std::mutex> lock(fftw_mutex);
-    
-    // Check if plan already exists for this size
-    if (plans.find(N) != plans.end()) {
+    maxPlans = plans;
+    maxBytes = bytes;
+    evict(dropped);
+}
+
+template<typename Real>
+FFTPlanStats BasicFFT<Real>::stats() {
+    FFTPlanStats s;
+    s.hits = hits.load(std::memory_order_relaxed);
+    s.misses = misses.load(std::memory_order_relaxed);
+    s.evictions = evictions.load(std::memory_order_relaxed);
+    s.planning = std::chrono::nanoseconds(planningNanos.load(std::memory_order_relaxed));
+    s.livePlans = livePlans.load(std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(fftw_mutex);
+    s.cachedPlans = plans.size();
+    s.cachedBytes = cachedBytes;
+    return s;
+}
+
+// called with fftw_mutex held. the plans go to dropped, the caller destroys them unlocked
+template<typename Real>
+void BasicFFT<Real>::evict(std::vector<std::shared_ptr<const Plan>>& dropped) {
+    auto over = [] {
+        return (maxPlans && plans.size() > maxPlans) || (maxBytes && cachedBytes > maxBytes);
+    };
+
+    // the newest plan always stays, it is about to run
+    while (plans.size() > 1 && over()) {
+        auto oldest = plans.begin();
+        for (auto it = plans.begin(); it != plans.end(); ++it) {
+            if (it->second->lastUse.load(std::memory_order_relaxed) < oldest->second->lastUse.load(std::memory_order_relaxed)) {
+                oldest = it;
+            }
+        }
+
+        cachedBytes -= oldest->second->bytes;
+        dropped.push_back(std::move(oldest->second));
+        plans.erase(oldest);
+        evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+template<typename Real>
+void BasicFFT<Real>::saveWisdom() {
+    std::lock_guard<std::mutex> lock(fftw_mutex);
+    if (wisdomFile.empty() || !wisdomChanged) return;
+
+    // write beside the target and rename so a concurrent start never imports a partial file
+    std::string tmp = wisdomFile + ".tmp";
+    if (!Api::export_wisdom_to_filename(tmp.c_str())) {
+        std::cout << "could not write fft wisdom " << wisdomFile << "\n";
         return;
     }
-    
-    // Create new plans for this size
-    std::vector<std::complex<double>> temp(N);
-    
-    fftw_plan forward = fftw_plan_dft_1d(
-        N,
-        reinterpret_cast<fftw_complex*>(temp.data()),
-        reinterpret_cast<fftw_complex*>(temp.data()),
-        FFTW_FORWARD,
-        FFTW_ESTIMATE
-    );
-    
-    fftw_plan backward = fftw_plan_dft_1d(
-        N,
-        reinterpret_cast<fftw_complex*>(temp.data()),
-        reinterpret_cast<fftw_complex*>(temp.data()),
-        FFTW_BACKWARD,
-        FFTW_ESTIMATE
-    );
-    
-    plans[N] = {forward, backward};
-    
-    fftw_print_plan(forward);
+
+    std::error_code ec;
+    std::filesystem::rename(tmp, wisdomFile, ec);
+    if (ec) std::remove(tmp.c_str());
+    else wisdomChanged = false;
+}
+
+// called with fftw_mutex held
+template<typename Real>
+typename FFTW<Real>::plan BasicFFT<Real>::makePlan(const std::function<typename Api::plan(unsigned)>& make) {
+    switch (planning) {
+        case Planning::Estimate:
+            return make(FFTW_ESTIMATE);
+
+        case Planning::Measure:
+        case Planning::Patient: {
+            // anything not already in the wisdom is timed now and worth saving
+            typename Api::plan plan = make(planning == Planning::Measure ? FFTW_MEASURE : FFTW_PATIENT);
+            wisdomChanged = true;
+            return plan;
+        }
+
+        case Planning::WisdomOnly: {
+            // sizes the wisdom does not cover fall back to an estimated plan
+            typename Api::plan plan = make(FFTW_WISDOM_ONLY);
+            return plan ? plan : make(FFTW_ESTIMATE);
+        }
+    }
+    return nullptr;
+}
+
+template<typename Real>
+void BasicFFT<Real>::describe(typename Api::plan plan) {
+    if (!verbose.load(std::memory_order_relaxed)) return;
+    Api::print_plan(plan);
     std::cout << "\n";
 }
 
-void FFT::forward(std::vector<std::complex<double>>& data) {
+template<typename Real>
+std::shared_ptr<const typename BasicFFT<Real>::Plan> BasicFFT<Real>::plan(size_t N, size_t count, Kind kind) {
+    // each thread indexes the plans it has used. fftw_execute is thread safe, so while a plan
+    // stays cached its thread never takes the lock for it again. the index only holds weak
+    // references, an evicted plan goes when its last running transform returns. its expired
+    // entry still pins the make_shared block, so they are swept once evictions have moved
+    struct ThreadCache {
+        uint64_t generation = 0;
+        uint64_t evictions = 0;
+        std::map<PlanKey, std::weak_ptr<const Plan>> plans;
+    };
+    thread_local ThreadCache cache;
+
+    uint64_t current = generation.load(std::memory_order_acquire);
+    if (cache.generation != current) {
+        cache.plans.clear();
+        cache.generation = current;
+    }
+    uint64_t evicted = evictions.load(std::memory_order_relaxed);
+    if (cache.evictions != evicted) {
+        std::erase_if(cache.plans, [](const auto& entry) { return entry.second.expired(); });
+        cache.evictions = evicted;
+    }
+
+    PlanKey key{N, count, kind};
+    auto it = cache.plans.find(key);
+    if (it != cache.plans.end()) {
+        if (std::shared_ptr<const Plan> shared = it->second.lock()) {
+            hits.fetch_add(1, std::memory_order_relaxed);
+            shared->lastUse.store(useClock.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+            return shared;
+        }
+    }
+
+    std::vector<std::shared_ptr<const Plan>> dropped; // destroyed after the lock is released
+    std::shared_ptr<const Plan> shared;
+    {
+        std::lock_guard<std::mutex> lock(fftw_mutex);
+        auto found = plans.find(key);
+        if (found != plans.end()) {
+            shared = found->second;
+            hits.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            auto start = std::chrono::steady_clock::now();
+            shared = build(N, count, kind);
+            planningNanos.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+            misses.fetch_add(1, std::memory_order_relaxed);
+
+            plans.emplace(key, shared);
+            cachedBytes += shared->bytes;
+        }
+        shared->lastUse.store(useClock.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+        evict(dropped);
+    }
+
+    cache.plans[key] = shared;
+    return shared;
+}
+
+// called with fftw_mutex held. a count of 1 is a single transform
+template<typename Real>
+std::shared_ptr<const typename BasicFFT<Real>::Plan> BasicFFT<Real>::build(size_t N, size_t count, Kind kind) {
+    auto pair = std::make_shared<Plan>();
+    int n = N;
+
+    if (kind == Kind::Dft) {
+        Buffer temp(N * count);
+        typename Api::complex* data = reinterpret_cast<typename Api::complex*>(temp.data());
+
+        for (int sign : {FFTW_FORWARD, FFTW_BACKWARD}) {
+            typename Api::plan p = makePlan([&](unsigned flags) {
+                if (count == 1) return Api::plan_dft_1d(N, data, data, sign, flags);
+                return Api::plan_many_dft(
+                    1, &n, count,
+                    data, nullptr, 1, N,
+                    data, nullptr, 1, N,
+                    sign,
+                    flags
+                );
+            });
+            (sign == FFTW_FORWARD ? pair->forward : pair->backward) = p;
+        }
+    } else if (kind == Kind::RealDft) {
+        // out of place: c2r overwrites its input, backward() hands it a copy
+        RealBuffer samples(N * count);
+        Buffer half((N / 2 + 1) * count);
+        typename Api::complex* bins = reinterpret_cast<typename Api::complex*>(half.data());
+
+        pair->forward = makePlan([&](unsigned flags) {
+            if (count == 1) return Api::plan_dft_r2c_1d(N, samples.data(), bins, flags);
+            return Api::plan_many_dft_r2c(
+                1, &n, count,
+                samples.data(), nullptr, 1, N,
+                bins, nullptr, 1, N / 2 + 1,
+                flags
+            );
+        });
+
+        pair->backward = makePlan([&](unsigned flags) {
+            if (count == 1) return Api::plan_dft_c2r_1d(N, bins, samples.data(), flags);
+            return Api::plan_many_dft_c2r(
+                1, &n, count,
+                bins, nullptr, 1, N / 2 + 1,
+                samples.data(), nullptr, 1, N,
+                flags
+            );
+        });
+    } else {
+        // out of place r2r keeps its input
+        RealBuffer in(N * count), out(N * count);
+
+        for (fftw_r2r_kind r2r : {FFTW_REDFT10, FFTW_REDFT01}) {
+            typename Api::plan p = makePlan([&](unsigned flags) {
+                return Api::plan_many_r2r(
+                    1, &n, count,
+                    in.data(), nullptr, 1, N,
+                    out.data(), nullptr, 1, N,
+                    &r2r,
+                    flags
+                );
+            });
+            (r2r == FFTW_REDFT10 ? pair->forward : pair->backward) = p;
+        }
+    }
+
+    // a twiddle per sample and direction, a real transform's are half as many
+    pair->bytes = (kind == Kind::Dft ? 2 : 1) * N * sizeof(Complex);
+    describe(pair->forward);
+    return pair;
+}
+
+template<typename Real>
+void BasicFFT<Real>::cleanup() {
+    saveWisdom();
+
+    if (verbose.load(std::memory_order_relaxed) && misses.load(std::memory_order_relaxed)) {
+        FFTPlanStats s = stats();
+        std::cout << "fft plans: " << s.hits << " hits, " << s.misses << " misses, " << s.evictions
+                  << " evictions, " << s.planning.count() / 1e6 << " ms planning, " << s.cachedPlans
+                  << " cached (" << s.cachedBytes / 1024 << " KiB), " << s.livePlans << " live\n";
+    }
+
+    // plans still held by a thread's cache go when that thread next sees the new
+    // generation, the last owner destroys them under the lock, so drop ours unlocked
+    std::map<PlanKey, std::shared_ptr<const Plan>> dropped;
+    {
+        std::lock_guard<std::mutex> lock(fftw_mutex);
+        dropped.swap(plans);
+        cachedBytes = 0;
+        generation.fetch_add(1, std::memory_order_release);
+    }
+}
+
+#else
+// without fftw there is nothing to plan, tune or cache
+
+template<typename Real>
+void BasicFFT<Real>::setPlanning(Planning) {}
+
+template<typename Real>
+void BasicFFT<Real>::setVerbose(bool) {}
+
+template<typename Real>
+bool BasicFFT<Real>::setWisdomFile(const std::string&) {
+    return false;
+}
+
+template<typename Real>
+void BasicFFT<Real>::saveWisdom() {}
+
+template<typename Real>
+void BasicFFT<Real>::setCacheLimits(size_t, size_t) {}
+
+template<typename Real>
+FFTPlanStats BasicFFT<Real>::stats() {
+    return {};
+}
+
+template<typename Real>
+void BasicFFT<Real>::cleanup() {}
+#endif
+
+template<typename Real>
+std::atomic<FFTBackend> BasicFFT<Real>::backend{FFTBackend::FFTW};
+
+template<typename Real>
+void BasicFFT<Real>::setBackend(Backend b) {
+    backend.store(b, std::memory_order_relaxed);
+}
+
+template<typename Real>
+bool BasicFFT<Real>::builtin([[maybe_unused]] size_t N) {
+#if IMAGECOMPRESSION_FFTW
+    Backend b = backend.load(std::memory_order_relaxed);
+    return b == Backend::Builtin || (b == Backend::Auto && Builtin::hasKernel(N));
+#else
+    return true;
+#endif
+}
+
+template<typename Real>
+void BasicFFT<Real>::init([[maybe_unused]] size_t N) {
+#if IMAGECOMPRESSION_FFTW
+    if (!builtin(N)) plan(N, 1, Kind::Dft);
+#endif
+}
+
+template<typename Real>
+void BasicFFT<Real>::forward(Buffer& data) {
     size_t N = data.size();
-    
-    auto it = plans.find(N);
-    assert(it != plans.end() && "FFT::init must be called before forward");
-    
-    fftw_execute_dft(it->second.forward,
-        reinterpret_cast<fftw_complex*>(data.data()),
-        reinterpret_cast<fftw_complex*>(data.data()));
+    if (builtin(N)) return Builtin::transform(data.data(), N, 1, false);
+#if IMAGECOMPRESSION_FFTW
+    assert(simdAligned<Real>(data.data()));
+
+    Api::execute_dft(plan(N, 1, Kind::Dft)->forward,
+        reinterpret_cast<typename Api::complex*>(data.data()),
+        reinterpret_cast<typename Api::complex*>(data.data()));
+#endif
 }
 
-void FFT::backward(std::vector<std::complex<double>>& data) {
+template<typename Real>
+void BasicFFT<Real>::backward(Buffer& data) {
     size_t N = data.size();
-    
-    auto it = plans.find(N);
-    assert(it != plans.end() && "FFT::init must be called before backward");
-    
-    fftw_execute_dft(it->second.backward,
-        reinterpret_cast<fftw_complex*>(data.data()),
-        reinterpret_cast<fftw_complex*>(data.data()));
+    if (builtin(N)) return Builtin::transform(data.data(), N, 1, true);
+#if IMAGECOMPRESSION_FFTW
+    assert(simdAligned<Real>(data.data()));
+
+    Api::execute_dft(plan(N, 1, Kind::Dft)->backward,
+        reinterpret_cast<typename Api::complex*>(data.data()),
+        reinterpret_cast<typename Api::complex*>(data.data()));
+#endif
 }
 
-void FFT::cleanup() {
-    std::lock_guard<std::mutex> lock(fftw_mutex);
-    
-    for (auto& [size, plan_pair] : plans) {
-        if (plan_pair.forward) fftw_destroy_plan(plan_pair.forward);
-        if (plan_pair.backward) fftw_destroy_plan(plan_pair.backward);
-    }
-    
-    plans.clear();
-}
\ No newline at end of file
+template<typename Real>
+void BasicFFT<Real>::initReal([[maybe_unused]] size_t N) {
+#if IMAGECOMPRESSION_FFTW
+    if (!builtin(N)) plan(N, 1, Kind::RealDft);
+#endif
+}
+
+template<typename Real>
+void BasicFFT<Real>::forward(const RealBuffer& in, Buffer& out) {
+    size_t N = in.size();
+
+    out.resize(N / 2 + 1);
+    if (builtin(N)) return Builtin::forwardReal(in.data(), out.data(), N, 1);
+#if IMAGECOMPRESSION_FFTW
+    assert(simdAligned<Real>(in.data()) && simdAligned<Real>(out.data()));
+    // r2c leaves its input alone
+    Api::execute_dft_r2c(plan(N, 1, Kind::RealDft)->forward,
+        const_cast<Real*>(in.data()),
+        reinterpret_cast<typename Api::complex*>(out.data()));
+#endif
+}
+
+template<typename Real>
+void BasicFFT<Real>::backward(const Buffer& in, RealBuffer& out) {
+    size_t N = out.size();
+    assert(in.size() == N / 2 + 1);
+    if (builtin(N)) return Builtin::backwardReal(in.data(), out.data(), N, 1);
+#if IMAGECOMPRESSION_FFTW
+    assert(simdAligned<Real>(out.data()));
+
+    auto temp = in;
+    Api::execute_dft_c2r(plan(N, 1, Kind::RealDft)->backward,
+        reinterpret_cast<typename Api::complex*>(temp.data()),
+        out.data());
+#endif
+}
+
+template<typename Real>
+void BasicFFT<Real>::initMany([[maybe_unused]] size_t N, [[maybe_unused]] size_t count) {
+#if IMAGECOMPRESSION_FFTW
+    if (!builtin(N)) plan(N, count, Kind::Dft);
+#endif
+}
+
+template<typename Real>
+void BasicFFT<Real>::initRealMany([[maybe_unused]] size_t N, [[maybe_unused]] size_t count) {
+#if IMAGECOMPRESSION_FFTW
+    if (!builtin(N)) plan(N, count, Kind::RealDft);
+#endif
+}
+
+template<typename Real>
+void BasicFFT<Real>::initDCTMany([[maybe_unused]] size_t N, [[maybe_unused]] size_t count) {
+#if IMAGECOMPRESSION_FFTW
+    if (!builtin(N)) plan(N, count, Kind::Dct);
+#endif
+}
+
+template<typename Real>
+void BasicFFT<Real>::forwardMany(Buffer& data, size_t N) {
+    if (builtin(N)) return Builtin::transform(data.data(), N, data.size() / N, false);
+#if IMAGECOMPRESSION_FFTW
+    assert(simdAligned<Real>(data.data()));
+    Api::execute_dft(plan(N, data.size() / N, Kind::Dft)->forward,
+        reinterpret_cast<typename Api::complex*>(data.data()),
+        reinterpret_cast<typename Api::complex*>(data.data()));
+#endif
+}
+
+template<typename Real>
+void BasicFFT<Real>::backwardMany(Buffer& data, size_t N) {
+    if (builtin(N)) return Builtin::transform(data.data(), N, data.size() / N, true);
+#if IMAGECOMPRESSION_FFTW
+    assert(simdAligned<Real>(data.data()));
+    Api::execute_dft(plan(N, data.size() / N, Kind::Dft)->backward,
+        reinterpret_cast<typename Api::complex*>(data.data()),
+        reinterpret_cast<typename Api::complex*>(data.data()));
+#endif
+}
+
+template<typename Real>
+void BasicFFT<Real>::forwardMany(const RealBuffer& in, Buffer& out, size_t N) {
+    size_t count = in.size() / N;
+
+    out.resize((N / 2 + 1) * count);
+    if (builtin(N)) return Builtin::forwardReal(in.data(), out.data(), N, count);
+#if IMAGECOMPRESSION_FFTW
+    assert(simdAligned<Real>(in.data()) && simdAligned<Real>(out.data()));
+    Api::execute_dft_r2c(plan(N, count, Kind::RealDft)->forward,
+        const_cast<Real*>(in.data()),
+        reinterpret_cast<typename Api::complex*>(out.data()));
+#endif
+}
+
+template<typename Real>
+void BasicFFT<Real>::backwardMany(const Buffer& in, RealBuffer& out, size_t N) {
+    size_t count = in.size() / (N / 2 + 1);
+
+    out.resize(N * count);
+    if (builtin(N)) return Builtin::backwardReal(in.data(), out.data(), N, count);
+#if IMAGECOMPRESSION_FFTW
+    assert(simdAligned<Real>(out.data()));
+    auto temp = in;
+    Api::execute_dft_c2r(plan(N, count, Kind::RealDft)->backward,
+        reinterpret_cast<typename Api::complex*>(temp.data()),
+        out.data());
+#endif
+}
+
+template<typename Real>
+void BasicFFT<Real>::dctMany(const RealBuffer& in, RealBuffer& out, size_t N) {
+    size_t count = in.size() / N;
+
+    out.resize(N * count);
+    if (builtin(N)) return Builtin::dct(in.data(), out.data(), N, count, false);
+#if IMAGECOMPRESSION_FFTW
+    assert(simdAligned<Real>(in.data()) && simdAligned<Real>(out.data()));
+    Api::execute_r2r(plan(N, count, Kind::Dct)->forward, const_cast<Real*>(in.data()), out.data());
+#endif
+}
+
+template<typename Real>
+void BasicFFT<Real>::idctMany(const RealBuffer& in, RealBuffer& out, size_t N) {
+    size_t count = in.size() / N;
+
+    out.resize(N * count);
+    if (builtin(N)) return Builtin::dct(in.data(), out.data(), N, count, true);
+#if IMAGECOMPRESSION_FFTW
+    assert(simdAligned<Real>(in.data()) && simdAligned<Real>(out.data()));
+    Api::execute_r2r(plan(N, count, Kind::Dct)->backward, const_cast<Real*>(in.data()), out.data());
+#endif
+}
+
+// the direct sums measured faster than a batched r2c up to K of about half the bits of N
+template<typename Real>
+void BasicFFT<Real>::forwardLowMany(const RealBuffer& in, Buffer& out, size_t N, size_t K) {
+    assert(K <= N / 2 + 1);
+    size_t count = in.size() / N;
+    size_t bins = N / 2 + 1;
+
+    if (K <= (size_t)std::bit_width(N) / 2) {
+        out.resize(K * count);
+        return Builtin::forwardLow(in.data(), out.data(), N, K, count);
+    }
+    if (K == bins) return forwardMany(in, out, N);
+
+    thread_local Buffer spectra;
+    forwardMany(in, spectra, N);
+    out.resize(K * count);
+    for (size_t g = 0; g < count; g++) {
+        std::copy_n(spectra.begin() + g * bins, K, out.begin() + g * K);
+    }
+}
+
+// output n = j * r + s of a length N inverse is sum_k X_k e^(2 pi i k s / N) e^(2 pi i k j / P),
+// one length P inverse per phase s of the bins times their twiddles
+template<typename Real>
+void BasicFFT<Real>::backwardPrunedMany(const Buffer& in, Buffer& out, size_t N, size_t bins) {
+    assert(bins && bins <= N);
+    size_t count = in.size() / bins;
+    size_t half = (bins + 1) / 2;
+    size_t P = prunedLength(N, bins);
+
+    // bin i of the input sits at i of the length P spectra, the negative ones at the end
+    thread_local Buffer tw;
+    prunedTwiddles(tw, Builtin::rootTable(N, true).data(), N, P, half, bins - half);
+
+    out.resize(N * count);
+    if (builtin(P)) {
+        return Builtin::pruned(N, P, count, tw.data(),
+            [&](size_t g, size_t i) {
+                const Complex* x = in.data() + g * bins;
+                if (i < half) return x[i];
+                return i + bins < P + half ? Complex(0, 0) : x[i + bins - P];
+            },
+            [&](size_t g, size_t n, Complex v) { out[g * N + n] = v; });
+    }
+#if IMAGECOMPRESSION_FFTW
+    // a spectrum at a time, so the phases and their interleave stay in cache. unpruned it is
+    // just the padded batch in out
+    size_t r = N / P;
+    thread_local Buffer spectra;
+    spectra.resize(N);
+    for (size_t g = 0; g < count; g++) {
+        const Complex* x = in.data() + g * bins;
+        Complex* y = r > 1 ? spectra.data() : out.data() + g * N;
+        for (size_t s = 0; s < r; s++, y += P) {
+            const Complex* t = tw.data() + s * P;
+            for (size_t i = 0; i < half; i++) y[i] = x[i] * t[i];
+            std::fill(y + half, y + P - bins + half, Complex(0, 0));
+            for (size_t i = P - bins + half; i < P; i++) y[i] = x[i + bins - P] * t[i];
+        }
+        if (r == 1) continue;
+        backwardMany(spectra, P);
+
+        Complex* to = out.data() + g * N;
+        for (size_t j = 0; j < P; j++) {
+            for (size_t s = 0; s < r; s++) to[j * r + s] = spectra[s * P + j];
+        }
+    }
+    if (r == 1) backwardMany(out, N);
+#endif
+}
+
+// the same with half spectra: the phases' spectra stay hermitian, so they are real inverses.
+// bins up to P / 2 fit, a bin landing on P / 2 is the pair +-k of the long spectrum and
+// counts twice, as the nyquist bin of a real inverse counts once
+template<typename Real>
+void BasicFFT<Real>::backwardPrunedMany(const Buffer& in, RealBuffer& out, size_t N, size_t bins) {
+    assert(bins && bins <= N / 2 + 1);
+    size_t count = in.size() / bins;
+    size_t P = prunedLength(N, 2 * (bins - 1));
+    if (!builtin(P)) P = N; // fftw's c2r already halves the work, its phases measured slower
+    size_t r = N / P;
+    size_t halfP = P / 2 + 1;
+
+    // the built in inverse is complex, so the upper half is mirrored into it
+    thread_local Buffer tw;
+    prunedTwiddles(tw, Builtin::rootTable(N, true).data(), N, P, bins, std::min(bins - 1, P - halfP));
+    if (r > 1 && 2 * (bins - 1) == P) {
+        for (size_t s = 0; s < r; s++) tw[s * P + bins - 1] *= (Real)2;
+    }
+
+    out.resize(N * count);
+    if (builtin(P)) {
+        return Builtin::pruned(N, P, count, tw.data(),
+            [&](size_t g, size_t i) {
+                const Complex* x = in.data() + g * bins;
+                if (i < bins) return x[i];
+                return i >= halfP && P - i < bins ? std::conj(x[P - i]) : Complex(0, 0);
+            },
+            [&](size_t g, size_t n, Complex v) { out[g * N + n] = v.real(); });
+    }
+#if IMAGECOMPRESSION_FFTW
+    thread_local Buffer spectra;
+    thread_local RealBuffer phases;
+    spectra.resize(halfP * (r > 1 ? r : count));
+    for (size_t g = 0; g < count; g++) {
+        const Complex* x = in.data() + g * bins;
+        Complex* y = spectra.data() + (r > 1 ? 0 : g * halfP);
+        for (size_t s = 0; s < r; s++, y += halfP) {
+            const Complex* t = tw.data() + s * P;
+            for (size_t i = 0; i < bins; i++) y[i] = x[i] * t[i];
+            std::fill(y + bins, y + halfP, Complex(0, 0));
+        }
+        if (r == 1) continue;
+        backwardMany(spectra, phases, P);
+
+        Real* to = out.data() + g * N;
+        for (size_t j = 0; j < P; j++) {
+            for (size_t s = 0; s < r; s++) to[j * r + s] = phases[s * P + j];
+        }
+    }
+    if (r == 1) backwardMany(spectra, out, N);
+#endif
+}
+
+template class BasicFFT<double>;
+template class BasicFFT<float>;
\ No newline at end of file
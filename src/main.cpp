@@ -1,16 +1,22 @@
 #include <algorithm>
+#include <chrono>
+#include <climits>
 #include <cmath>
 #include <complex>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <stdexcept>
 #include <string>
 #include <thread>
 #include <unistd.h>
 #include <utility>
 #include <vector>
-#include <hilbert.hpp>
+#include <compactcurve.hpp>
+#include <curvetable.hpp>
+#include <permute.hpp>
 #include <fstream>
 
-#include <fftw3.h>
 #include <fftwrap.hpp>
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -18,12 +24,19 @@
 
 #include <threadpool.h>
 
-class Subsect {
+// one segment of the curve ordered pixels and its luma / chroma signals. Real is the
+// precision of the chroma samples and of every transform
+template<typename Real>
+class BasicSubsect {
     private:
     public:
+    using Complex = std::complex<Real>;
+    using Transform = BasicFFT<Real>;
+    using Buffer = typename Transform::Buffer;
+    using RealBuffer = typename Transform::RealBuffer;
 
     std::vector<unsigned char> Y;
-    std::vector<std::complex<double>> CbCr; // joined to save FFT operations
+    Buffer CbCr; // joined to save FFT operations
 
     std::vector<unsigned char> raw;
 
@@ -35,7 +48,6 @@ class Subsect {
             throw std::out_of_range("assignRawData: invalid range");
         }
         raw.assign(data.begin() + start, data.begin() + end);
-        FFT::init(raw.size());
         this->start = start;
         this->end = end;
     }
@@ -107,29 +119,15 @@ class Subsect {
         // upscale CbCr if needed
         if (!CbCr.empty() && CbCr.size() != np) {
             size_t oldSize = CbCr.size();
-            size_t half = (oldSize + 1) / 2;
             
-            FFT::init(oldSize);
-            FFT::forward(CbCr);
+            Transform::init(oldSize);
+            Transform::forward(CbCr);
             
-            // normalize after forward FFT
-            for (auto& f : CbCr) f /= (double)oldSize;
+            Buffer temp(np);
+            padSpectrum(CbCr.data(), oldSize, temp.data(), np);
             
-            // create new padded array
-            std::vector<std::complex<double>> temp(np, {0.0, 0.0});
-            
-            // copy low (positive) frequencies to beginning
-            for (size_t i = 0; i < half; i++) {
-                temp[i] = CbCr[i];
-            }
-            
-            // copy high (negative) frequencies to end
-            for (size_t i = half; i < oldSize; i++) {
-                temp[np - (oldSize - i)] = CbCr[i];
-            }
-            
-            FFT::init(np);
-            FFT::backward(temp);
+            Transform::init(np);
+            Transform::backward(temp);
             
             CbCr = std::move(temp);
         }
@@ -137,22 +135,12 @@ class Subsect {
         // upscale Y if needed
         if (!Y.empty() && Y.size() != np) {
             size_t oldY = Y.size();
-            size_t halfY = (oldY + 1) / 2;
-            auto tempY = toWaves(Y);
-            size_t NY = tempY.size();
-            
-            std::vector<std::complex<double>> paddedY(np, {0.0, 0.0});
-            
-            for (size_t i = 0; i < halfY; i++) {
-                paddedY[i] = tempY[i];
-            }
+            auto wavesY = toWaves(Y, std::min(oldY / 2 + 1, np / 2 + 1));
 
-            for (size_t i = halfY; i < NY; i++) {
-                paddedY[np - (NY - i)] = tempY[i];
-            }
+            Buffer paddedY(np / 2 + 1);
+            padHalfSpectrum(wavesY.data(), oldY, paddedY.data(), np);
 
-            FFT::init(np);
-            Y = toData(paddedY);
+            Y = toData(paddedY, np);
         }
 
         raw.assign(segLen, 0);
@@ -182,28 +170,59 @@ class Subsect {
         }
     }
     
-    std::vector<std::complex<double>> toWaves(const std::vector<unsigned char>& data) {
-        std::vector<std::complex<double>> waves;
-        waves.reserve(data.size());
-        for (unsigned char v : data) {
-            waves.emplace_back((double)v, 0.0);
+    // unnormalized spectrum of oldSize bins -> normalized and zero padded to np bins
+    static void padSpectrum(const Complex* waves, size_t oldSize, Complex* out, size_t np) {
+        size_t half = (oldSize + 1) / 2;
+        std::fill(out, out + np, Complex(0.0, 0.0));
+
+        // copy low (positive) frequencies to beginning
+        for (size_t i = 0; i < half; i++) {
+            out[i] = waves[i] / (Real)oldSize;
         }
-        
-        FFT::init(waves.size());
-        FFT::forward(waves);
-        for (auto& i : waves) i /= (double)data.size();
+
+        // copy high (negative) frequencies to end
+        for (size_t i = half; i < oldSize; i++) {
+            out[np - (oldSize - i)] = waves[i] / (Real)oldSize;
+        }
+    }
+
+    // half spectrum of oldSize real samples -> zero padded half spectrum of np samples.
+    // zero padding a half spectrum is just more zero bins on the end
+    static void padHalfSpectrum(const Complex* waves, size_t oldSize, Complex* out, size_t np) {
+        size_t keep = std::min(oldSize / 2 + 1, np / 2 + 1);
+        std::fill(out, out + np / 2 + 1, Complex(0.0, 0.0));
+        std::copy(waves, waves + keep, out);
+
+        // an even length's nyquist bin stands for both +-oldSize/2, in the longer
+        // spectrum those are two bins, so it is split between them
+        if (oldSize % 2 == 0 && oldSize / 2 < keep) out[oldSize / 2] *= 0.5;
+    }
+
+    static unsigned char toByte(double v) {
+        return (unsigned char) std::clamp(std::lround(v), 0L, 255L);
+    }
+
+    // the lowest bins of the half spectrum of real samples, at most data.size() / 2 + 1,
+    // normalized
+    Buffer toWaves(const std::vector<unsigned char>& data, size_t bins) {
+        RealBuffer samples(data.begin(), data.end());
+        Buffer waves;
+
+        Transform::forwardLowMany(samples, waves, samples.size(), bins);
+        for (auto& i : waves) i /= (Real)data.size();
         return waves; 
     }
 
-    std::vector<unsigned char> toData(const std::vector<std::complex<double>>& data) {
-        std::vector<unsigned char> raw(data.size());
+    // n real samples back from their half spectrum
+    std::vector<unsigned char> toData(const Buffer& data, size_t n) {
+        std::vector<unsigned char> raw(n);
+        RealBuffer temp(n);
 
-        auto temp = data;
-        FFT::init(temp.size());
-        FFT::backward(temp);
+        Transform::initReal(n);
+        Transform::backward(data, temp);
 
-        for (size_t i = 0; i < temp.size(); i++) {
-            raw[i] = (unsigned char) std::clamp((long)(abs(temp[i])), 0L, 255L);
+        for (size_t i = 0; i < n; i++) {
+            raw[i] = toByte(temp[i]);
         }
 
         return raw;
@@ -225,39 +244,128 @@ class Subsect {
     }
 };
 
-class Image {
+using Subsect = BasicSubsect<double>;
+
+// pixels, curve layout and segments of one image. Real is the segments' precision
+template<typename Real>
+class BasicImage {
 public:
+    using Segment = BasicSubsect<Real>;
+    using Transform = BasicFFT<Real>;
+
     int width;
     int height;
     int channels;
     long segLen;
     size_t length;
     size_t rawLength;
+    long tileSize = 0; // curve layout tile, 0 = one curve over the whole image
+    CurveKind curve = CurveKind::Gilbert;
+    bool smoothSegments = true; // fft friendly segment lengths, see smoothSplit()
+    bool cosineBasis = false; // resample through the dct instead of the dft, see cosineResample()
+
+    // pixels per chroma sample
+    static constexpr size_t chromaScale = 4;
 
     std::vector<unsigned char> rawData; // standard linear mapping
     std::vector<unsigned char> hilbMap; // hilbert mapping
 
-    std::vector<Subsect> subsects;
+    std::vector<Segment> subsects;
+
+    BasicImage() = default;
+
+    // the same pixels and layout for a run in another precision, no segments
+    template<typename Other>
+    explicit BasicImage(const BasicImage<Other>& other)
+    : width(other.width), height(other.height), channels(other.channels),
+      length(other.length), rawLength(other.rawLength), tileSize(other.tileSize), curve(other.curve),
+      smoothSegments(other.smoothSegments), cosineBasis(other.cosineBasis), rawData(other.rawData) {}
 
     void loadImage(const std::string& path) {
-        unsigned char* temp = stbi_load(path.c_str(), &width, &height, &channels, 3);
-        if (temp) {
-            channels = 3;
-            length = width * height;
-            rawLength = length * channels;
-            rawData.resize(rawLength);
-            rawData.assign(temp, temp + rawLength);
-            STBI_FREE(temp);
-        } else {
-            std::cout << "error loading image!\n";
-            throw;
+        if (!loadPPM(path)) {
+            unsigned char* temp = stbi_load(path.c_str(), &width, &height, &channels, 3);
+            if (temp) {
+                channels = 3;
+                length = (size_t)width * height;
+                rawLength = length * channels;
+                rawData.resize(rawLength);
+                rawData.assign(temp, temp + rawLength);
+                STBI_FREE(temp);
+            } else {
+                std::cout << "error loading image!\n";
+                throw std::runtime_error(stbi_failure_reason());
+            }
         }
         std::cout << "width: " << width << "\nheight: " << height << "\npixels: " << length << "\nchannels: " << channels << "\n";
     }
 
-    void subdivide(std::vector<unsigned char> data, long count) {
+    // binary P6 is read directly, stb refuses anything past 2GB of pixels
+    bool loadPPM(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        std::string magic;
+        if (!(in >> magic) || magic != "P6") return false;
+
+        auto next = [&]() {
+            long v = -1;
+            while (in >> std::ws && in.peek() == '#') in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+            in >> v;
+            return v;
+        };
+
+        long w = next();
+        long h = next();
+        long maxval = next();
+        in.get(); // single whitespace before the pixels
+
+        if (!in || w <= 0 || h <= 0 || w > INT_MAX || h > INT_MAX || maxval != 255) {
+            throw std::runtime_error("loadImage: unsupported ppm header");
+        }
+
+        width = w;
+        height = h;
+        channels = 3;
+        length = (size_t)w * h;
+        rawLength = length * channels;
+        rawData.resize(rawLength);
+        in.read(reinterpret_cast<char*>(rawData.data()), rawLength);
+        if (!in) throw std::runtime_error("loadImage: truncated ppm");
+        return true;
+    }
+
+    // 32 bit curve tables up to 4G pixels, 64 bit past that
+    bool wideIndex() const {
+        return length > UINT32_MAX;
+    }
+
+    // past this many pixels the full tables would outweigh the image, so the
+    // remap decodes a CompactCurve instead
+    static constexpr size_t compactThreshold = size_t(1) << 28;
+
+    bool compactCurve() const {
+        return curve == CurveKind::Gilbert && tileSize == 0 && length > compactThreshold;
+    }
+
+    void subdivide(const std::vector<unsigned char>& data, long count) {
+        if (tileSize) {
+            bool tiled = wideIndex()
+                ? subdivideTiles(data, count, WideCurveTable::get(width, height, nullptr, tileSize, curve)->tileStart)
+                : subdivideTiles(data, count, CurveTable::get(width, height, nullptr, tileSize, curve)->tileStart);
+            if (tiled) return;
+        }
+
+        if (smoothSegments) {
+            size_t first = 0;
+            for (size_t pixels : smoothSplit(length, std::max(count, 1L))) {
+                Segment temp;
+                temp.assignRawData(data, channels * first, channels * (first + pixels));
+                subsects.push_back(std::move(temp));
+                first += pixels;
+            }
+            return;
+        }
+
         for (long i = 0; i < count; i++) {
-            Subsect temp;
+            Segment temp;
             long start = i * data.size()/count;
             start -= start % 3;
             long endExclusive = (i+1) * data.size()/count;
@@ -269,44 +377,716 @@ public:
         }
     }
 
+    // pixel counts of the count segments a run of pixels splits into. every count is
+    // chromaScale times a 2^a 3^b 5^c 7^d length, so both the luma and the chroma transforms
+    // stay on fftw's mixed radix codelets and an image plans only a few sizes. the last few
+    // segments take the remainder, each the largest such count that fits. segments shorter
+    // than chromaScale have no such length, those runs are cut evenly into count instead
+    static std::vector<size_t> smoothSplit(size_t pixels, size_t count) {
+        count = std::clamp<size_t>(count, 1, pixels);
+        std::vector<size_t> parts;
+        if (pixels / count < chromaScale) {
+            for (size_t i = 0; i < count; i++) parts.push_back((i + 1) * pixels / count - i * pixels / count);
+            return parts;
+        }
+
+        auto fits = [](size_t n) {
+            return n < chromaScale ? n : chromaScale * fftSmoothLength(n / chromaScale);
+        };
+        size_t step = fits(pixels / count);
+        for (; pixels >= step; pixels -= step) parts.push_back(step);
+        while (pixels) {
+            parts.push_back(fits(pixels));
+            pixels -= parts.back();
+        }
+        return parts;
+    }
+
+    // segments never straddle a tile, so every tile can be coded and streamed on its own
+    template<typename Index>
+    bool subdivideTiles(const std::vector<unsigned char>& data, long count, const std::vector<Index>& tileStart) {
+        if (tileStart.empty()) return false;
+
+        for (size_t t = 0; t + 1 < tileStart.size(); t++) {
+            size_t first = tileStart[t];
+            size_t pixels = tileStart[t + 1] - first;
+            size_t parts = std::clamp<size_t>(std::lround((double)count * pixels / length), 1, pixels);
+
+            if (smoothSegments) {
+                for (size_t part : smoothSplit(pixels, parts)) {
+                    Segment temp;
+                    temp.assignRawData(data, channels * first, channels * (first + part));
+                    subsects.push_back(std::move(temp));
+                    first += part;
+                }
+                continue;
+            }
+
+            for (size_t i = 0; i < parts; i++) {
+                Segment temp;
+                size_t start = channels * (first + i * pixels / parts);
+                size_t endExclusive = channels * (first + (i + 1) * pixels / parts);
+                temp.assignRawData(data, start, endExclusive);
+                subsects.push_back(std::move(temp));
+            }
+        }
+        return true;
+    }
+
+    // segments per batched transform call. a fixed cap bounds the plans per length,
+    // each count needs its own
+    static constexpr size_t fftBatch = 32;
+
+    // the chroma and luma upscales of subsects [first, last) together: segments with the same
+    // lengths are packed back to back and transformed a batch per plan call, then each
+    // segment only converts back to rgb
+    void fromYCbCr(size_t first, size_t last) {
+        std::map<std::pair<size_t, size_t>, std::vector<Segment*>> chroma, luma;
+        for (size_t i = first; i < last; i++) {
+            Segment& s = subsects[i];
+            size_t np = (s.end - s.start) / 3;
+            if (!s.CbCr.empty() && s.CbCr.size() != np) chroma[{s.CbCr.size(), np}].push_back(&s);
+            if (!s.Y.empty() && s.Y.size() != np) luma[{s.Y.size(), np}].push_back(&s);
+        }
+
+        for (auto& [sizes, group] : chroma) {
+            auto [oldSize, np] = sizes;
+            if (cosineBasis) {
+                cosineChroma(group, oldSize, np);
+                continue;
+            }
+
+            typename Segment::Buffer waves, padded;
+            for (size_t at = 0; at < group.size(); at += fftBatch) {
+                size_t count = std::min(fftBatch, group.size() - at);
+                Segment** part = group.data() + at;
+
+                waves.resize(oldSize * count);
+                for (size_t g = 0; g < count; g++) {
+                    std::copy(part[g]->CbCr.begin(), part[g]->CbCr.end(), waves.begin() + g * oldSize);
+                }
+                Transform::initMany(oldSize, count);
+                Transform::forwardMany(waves, oldSize);
+                for (auto& w : waves) w /= (Real)oldSize;
+
+                // only the oldSize bins of the padded spectra are non zero
+                Transform::backwardPrunedMany(waves, padded, np, oldSize);
+
+                for (size_t g = 0; g < count; g++) {
+                    part[g]->CbCr.assign(padded.begin() + g * np, padded.begin() + (g + 1) * np);
+                }
+            }
+        }
+
+        for (auto& [sizes, group] : luma) {
+            auto [oldSize, np] = sizes;
+            if (cosineBasis) {
+                cosineLuma(group, oldSize, np);
+                continue;
+            }
+            size_t oldBins = oldSize / 2 + 1;
+            size_t bins = np / 2 + 1;
+
+            typename Segment::RealBuffer samples;
+            typename Segment::Buffer waves, padded;
+            for (size_t at = 0; at < group.size(); at += fftBatch) {
+                size_t count = std::min(fftBatch, group.size() - at);
+                Segment** part = group.data() + at;
+
+                samples.resize(oldSize * count);
+                for (size_t g = 0; g < count; g++) {
+                    std::copy(part[g]->Y.begin(), part[g]->Y.end(), samples.begin() + g * oldSize);
+                }
+                // only the bins the padded half spectra keep
+                size_t keep = std::min(oldBins, bins);
+                Transform::forwardLowMany(samples, waves, oldSize, keep);
+                for (auto& w : waves) w /= (Real)oldSize;
+
+                // the rest of each padded half spectrum is zero. padding to the even length
+                // with keep bins splits the same nyquist bin as np would
+                padded.resize(keep * count);
+                for (size_t g = 0; g < count; g++) {
+                    Segment::padHalfSpectrum(&waves[g * keep], oldSize, &padded[g * keep], 2 * (keep - 1));
+                }
+                Transform::backwardPrunedMany(padded, samples, np, keep);
+
+                for (size_t g = 0; g < count; g++) {
+                    part[g]->Y.resize(np);
+                    for (size_t i = 0; i < np; i++) part[g]->Y[i] = Segment::toByte(samples[g * np + i]);
+                }
+            }
+        }
+
+        for (size_t i = first; i < last; i++) subsects[i].fromYCbCr();
+    }
+
+    // count real signals of oldSize samples in samples -> np samples each in out. the dct
+    // sees a signal mirrored at both ends instead of repeated, so unlike the dft there is
+    // no jump between the last and the first sample to ring across the upscale
+    static void cosineResample(typename Segment::RealBuffer& samples, typename Segment::RealBuffer& out,
+                               size_t oldSize, size_t np, size_t count) {
+        Transform::initDCTMany(oldSize, count);
+        Transform::dctMany(samples, out, oldSize);
+
+        // dct-iii at np of the first coefficients is the oldSize cosine series sampled at
+        // np points, 1 / 2N normalizes the pair
+        size_t keep = std::min(oldSize, np);
+        samples.assign(np * count, 0);
+        for (size_t g = 0; g < count; g++) {
+            for (size_t k = 0; k < keep; k++) samples[g * np + k] = out[g * oldSize + k] / (Real)(2 * oldSize);
+        }
+        Transform::initDCTMany(np, count);
+        Transform::idctMany(samples, out, np);
+    }
+
+    // Cb and Cr are two real signals for the dct
+    void cosineChroma(const std::vector<Segment*>& group, size_t oldSize, size_t np) {
+        typename Segment::RealBuffer samples, out;
+        for (size_t at = 0; at < group.size(); at += fftBatch / 2) {
+            size_t count = std::min(fftBatch / 2, group.size() - at);
+            Segment* const* part = group.data() + at;
+
+            samples.resize(2 * oldSize * count);
+            for (size_t g = 0; g < count; g++) {
+                for (size_t i = 0; i < oldSize; i++) {
+                    samples[2 * g * oldSize + i] = part[g]->CbCr[i].real();
+                    samples[(2 * g + 1) * oldSize + i] = part[g]->CbCr[i].imag();
+                }
+            }
+            cosineResample(samples, out, oldSize, np, 2 * count);
+
+            for (size_t g = 0; g < count; g++) {
+                part[g]->CbCr.resize(np);
+                for (size_t i = 0; i < np; i++) {
+                    part[g]->CbCr[i] = typename Segment::Complex(out[2 * g * np + i], out[(2 * g + 1) * np + i]);
+                }
+            }
+        }
+    }
+
+    void cosineLuma(const std::vector<Segment*>& group, size_t oldSize, size_t np) {
+        typename Segment::RealBuffer samples, out;
+        for (size_t at = 0; at < group.size(); at += fftBatch) {
+            size_t count = std::min(fftBatch, group.size() - at);
+            Segment* const* part = group.data() + at;
+
+            samples.resize(oldSize * count);
+            for (size_t g = 0; g < count; g++) {
+                std::copy(part[g]->Y.begin(), part[g]->Y.end(), samples.begin() + g * oldSize);
+            }
+            cosineResample(samples, out, oldSize, np, count);
+
+            for (size_t g = 0; g < count; g++) {
+                part[g]->Y.resize(np);
+                for (size_t i = 0; i < np; i++) part[g]->Y[i] = Segment::toByte(out[g * np + i]);
+            }
+        }
+    }
+
     void savePPM(const std::string& path) {
         std::ofstream out(path, std::ios::binary);
         out << "P6\n" << width << " " << height << "\n255\n";
         out.write(reinterpret_cast<char*>(rawData.data()), rawData.size());
     }
 
-    void rawToHilb() {
+    void rawToHilb(ThreadPool* pool = nullptr) {
         hilbMap.resize(rawLength);
-        for (int i = 0; i < height; i++) {
-            for (int j = 0; j < width; j++) {
-                int index = channels * (j + width * i);
-                int hilbidx = channels * gilbidx(j, i, width, height);
+        if (compactCurve()) compactRemap(*CompactCurve::get(width, height, pool), true, pool);
+        else if (wideIndex()) tableRemap(*WideCurveTable::get(width, height, pool, tileSize, curve), true, pool);
+        else tableRemap(*CurveTable::get(width, height, pool, tileSize, curve), true, pool);
+    }
+
+    void hilbToRaw(ThreadPool* pool = nullptr) {
+        if (compactCurve()) compactRemap(*CompactCurve::get(width, height, pool), false, pool);
+        else if (wideIndex()) tableRemap(*WideCurveTable::get(width, height, pool, tileSize, curve), false, pool);
+        else tableRemap(*CurveTable::get(width, height, pool, tileSize, curve), false, pool);
+    }
+
+    // gathers rawData into hilbMap along the table, or moves hilbMap back
+    template<typename Index>
+    void tableRemap(const BasicCurveTable<Index>& table, bool toHilb, ThreadPool* pool) {
+        bool gilbertTiles = channels == 3 && (curve == CurveKind::Gilbert || curve == CurveKind::Hilbert)
+            && (size_t)width * table.tileSize <= UINT32_MAX;
+        if (gilbertTiles && withGilbertTile(table.tileSize, [&](const auto& tile) { tileRemap(table, tile, toHilb, pool); })) {
+            return;
+        }
+
+        if (toHilb) remap(hilbMap, rawData, table.inverse, pool);
+        else remap(rawData, hilbMap, table.forward, pool);
+    }
+
+    // whole tiles of a prebuilt size gather with the compile time order, whose index tables
+    // stay in L1, instead of streaming the full size table. edge tiles read the table
+    template<typename Index, int Side>
+    void tileRemap(const BasicCurveTable<Index>& table, const GilbertTile<Side>& tile, bool toHilb, ThreadPool* pool) {
+        std::vector<uint32_t> offsets = tileOffsets(tile, width);
 
-                for (int k = 0; k < channels; k++) {
-                    hilbMap[hilbidx + k] = rawData[index + k];
+        auto run = [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; t++) {
+                size_t first = table.tileStart[t];
+                size_t pixels = table.tileStart[t + 1] - first;
+                unsigned char* along = hilbMap.data() + 3 * first;
+
+                if (pixels != Side * Side) {
+                    if (toHilb) gatherPixels<3>(along, rawData.data(), table.inverse.data() + first, pixels, rawData.size());
+                    else scatterPixels<3>(rawData.data(), along, table.inverse.data() + first, pixels);
+                    continue;
                 }
+
+                // any pixel of the tile gives its corner
+                size_t pixel = table.inverse[first];
+                size_t corner = 3 * (pixel % width / Side * Side + (size_t)width * (pixel / width / Side * Side));
+
+                if (toHilb) gatherPixels<3>(along, rawData.data() + corner, offsets.data(), Side * Side, rawData.size() - corner);
+                else scatterPixels<3>(rawData.data() + corner, along, offsets.data(), Side * Side);
             }
+        };
+
+        size_t tiles = table.tileStart.size() - 1;
+        if (pool) pool->parallelFor(tiles, run, 16);
+        else run(0, tiles);
+    }
+
+    // writes one decoded segment straight to its raster pixels without a full frame hilbMap.
+    // segments can start or end part way into a pixel, those bytes keep their channel
+    void scatterSegment(const Segment& s) {
+        size_t first = s.start / channels;
+        size_t last = (s.end + channels - 1) / channels;
+
+        auto put = [&](size_t pos, size_t pixel) {
+            size_t lo = std::max(s.start, channels * pos);
+            size_t hi = std::min(s.end, channels * (pos + 1));
+            for (size_t b = lo; b < hi; b++) {
+                rawData[channels * pixel + (b - channels * pos)] = s.raw[b - s.start];
+            }
+        };
+
+        if (curve == CurveKind::Gilbert && tileSize == 0) {
+            // the generator seeks to the segment in O(log n)
+            size_t pos = first;
+            for (auto [x, y] : GilbertCurve(width, height, first, last)) put(pos++, x + (size_t)width * y);
+        } else if (wideIndex()) {
+            auto table = WideCurveTable::get(width, height, nullptr, tileSize, curve);
+            for (size_t pos = first; pos < last; pos++) put(pos, table->inverse[pos]);
+        } else {
+            auto table = CurveTable::get(width, height, nullptr, tileSize, curve);
+            for (size_t pos = first; pos < last; pos++) put(pos, table->inverse[pos]);
         }
     }
 
-    void hilbToRaw() {
-        for (int i = 0; i < height; i++) {
-            for (int j = 0; j < width; j++) {
-                int index = channels * (j + width * i);
-                int hilbidx = channels * gilbidx(j, i, width, height);
+    // curve ranges [begin, end), in pixels, covering [x0, x1) x [y0, y1)
+    std::vector<std::pair<long, long>> curveRanges(long x0, long y0, long x1, long y1) {
+        if (curve == CurveKind::Gilbert && tileSize == 0) return gilbertRanges(x0, y0, x1, y1, width, height);
 
-                for (int k = 0; k < channels; k++) {
-                    rawData[index + k] = hilbMap[hilbidx + k];
+        // other layouts look every pixel up in the table
+        std::vector<long> positions;
+        auto collect = [&](const auto& forward) {
+            for (long y = std::max(y0, 0L); y < std::min(y1, (long)height); y++) {
+                for (long x = std::max(x0, 0L); x < std::min(x1, (long)width); x++) {
+                    positions.push_back(forward[x + (size_t)width * y]);
                 }
             }
+        };
+        if (wideIndex()) collect(WideCurveTable::get(width, height, nullptr, tileSize, curve)->forward);
+        else collect(CurveTable::get(width, height, nullptr, tileSize, curve)->forward);
+        std::sort(positions.begin(), positions.end());
+
+        std::vector<std::pair<long, long>> ranges;
+        for (long pos : positions) {
+            if (!ranges.empty() && ranges.back().second == pos) ranges.back().second++;
+            else ranges.emplace_back(pos, pos + 1);
         }
+        return ranges;
+    }
+
+    // indices of the subsects holding any pixel of [x0, x1) x [y0, y1), in order,
+    // so a crop or partial update only touches those
+    std::vector<size_t> subsectsIn(long x0, long y0, long x1, long y1) {
+        auto ranges = curveRanges(x0, y0, x1, y1);
+        std::vector<size_t> hits;
+
+        size_t r = 0;
+        for (size_t i = 0; i < subsects.size() && r < ranges.size(); i++) {
+            long first = subsects[i].start / channels;
+            long last = (subsects[i].end + channels - 1) / channels;
+            while (r < ranges.size() && ranges[r].second <= first) r++;
+            if (r < ranges.size() && ranges[r].first < last) hits.push_back(i);
+        }
+        return hits;
+    }
+
+    // dst pixel i = src pixel order[i]
+    template<typename Index>
+    void remap(std::vector<unsigned char>& dst, const std::vector<unsigned char>& src,
+               const std::vector<Index>& order, ThreadPool* pool) {
+        auto run = [&](size_t begin, size_t end) {
+            gatherPixels(dst.data() + channels * begin, src.data(), order.data() + begin,
+                         end - begin, src.size(), channels);
+        };
+
+        if (pool) pool->parallelFor(length, run, 1 << 16);
+        else run(0, length);
+    }
+
+    // decodes the curve a short run at a time into a small index buffer and moves those
+    // pixels with the table kernels: gathers rawData into hilbMap, or scatters hilbMap back
+    void compactRemap(const CompactCurve& curve, bool toHilb, ThreadPool* pool) {
+        if (wideIndex()) compactRemap<uint64_t>(curve, toHilb, pool);
+        else compactRemap<uint32_t>(curve, toHilb, pool);
+    }
+
+    template<typename Index>
+    void compactRemap(const CompactCurve& curve, bool toHilb, ThreadPool* pool) {
+        auto run = [&](size_t begin, size_t end) {
+            std::vector<Index> order(4096);
+            for (size_t pos = begin; pos < end; pos += order.size()) {
+                size_t count = std::min(order.size(), end - pos);
+                curve.decode(pos, count, order.data());
+                if (toHilb) {
+                    gatherPixels(hilbMap.data() + channels * pos, rawData.data(), order.data(),
+                                 count, rawData.size(), channels);
+                } else {
+                    scatterPixels(rawData.data(), hilbMap.data() + channels * pos, order.data(),
+                                  count, channels);
+                }
+            }
+        };
+
+        if (pool) pool->parallelFor(length, run, 1 << 16);
+        else run(0, length);
     }
     
 };
 
+using Image = BasicImage<double>;
+
+// single threaded remap throughput: the plain per-byte table loop against the gather kernel,
+// and the 32 bit tables against the 64 bit ones that gigapixel images need
+void benchRemap(Image& image, int reps = 10) {
+    auto timeBuild = [&](const char* name, auto&& get) {
+        auto t0 = std::chrono::steady_clock::now();
+        get();
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        std::cout << name << ": " << secs * 1e3 << " ms\n";
+    };
+
+    CurveTable::cleanup();
+    WideCurveTable::cleanup();
+    timeBuild("build 32 bit table", [&]() { CurveTable::get(image.width, image.height); });
+    timeBuild("build 64 bit table", [&]() { WideCurveTable::get(image.width, image.height); });
+
+    auto table = CurveTable::get(image.width, image.height);
+    auto wide = WideCurveTable::get(image.width, image.height);
+    image.hilbMap.resize(image.rawLength);
+    const size_t channels = image.channels;
+
+    auto timeIt = [&](const char* name, auto&& fn) {
+        fn(); // warm up
+        auto t0 = std::chrono::steady_clock::now();
+        for (int r = 0; r < reps; r++) fn();
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        std::cout << name << ": " << (image.rawLength * (double)reps / secs) / 1e9 << " GB/s\n";
+    };
+
+    timeIt("rawToHilb loop  ", [&]() {
+        for (size_t i = 0; i < image.length; i++) {
+            for (size_t k = 0; k < channels; k++) {
+                image.hilbMap[channels * i + k] = image.rawData[channels * table->inverse[i] + k];
+            }
+        }
+    });
+    timeIt("rawToHilb kernel", [&]() {
+        gatherPixels(image.hilbMap.data(), image.rawData.data(), table->inverse.data(),
+                     image.length, image.rawLength, channels);
+    });
+    timeIt("hilbToRaw loop  ", [&]() {
+        for (size_t i = 0; i < image.length; i++) {
+            for (size_t k = 0; k < channels; k++) {
+                image.rawData[channels * i + k] = image.hilbMap[channels * table->forward[i] + k];
+            }
+        }
+    });
+    timeIt("hilbToRaw kernel", [&]() {
+        gatherPixels(image.rawData.data(), image.hilbMap.data(), table->forward.data(),
+                     image.length, image.rawLength, channels);
+    });
+    auto compact = CompactCurve::get(image.width, image.height);
+    std::cout << "tables: " << (table->forward.size() + table->inverse.size()) * sizeof(uint32_t)
+              << " bytes, compact curve: " << compact->bytes() << " bytes\n";
+
+    timeIt("rawToHilb compact", [&]() { image.compactRemap(*compact, true, nullptr); });
+    timeIt("hilbToRaw compact", [&]() { image.compactRemap(*compact, false, nullptr); });
+    timeIt("rawToHilb 64 bit", [&]() {
+        gatherPixels(image.hilbMap.data(), image.rawData.data(), wide->inverse.data(),
+                     image.length, image.rawLength, channels);
+    });
+    timeIt("hilbToRaw 64 bit", [&]() {
+        gatherPixels(image.rawData.data(), image.hilbMap.data(), wide->forward.data(),
+                     image.length, image.rawLength, channels);
+    });
+}
+
+uint64_t benchSink = 0; // keeps timed loops from being optimized out
+
+// per curve: order build and point key throughput, and how compact the coded signal is.
+// compactness is the share of non-DC luma energy in the lowest eighth of each segment's
+// spectrum, with segments as long as the ones main() codes
+void benchCurves(Image& image) {
+    size_t segment = std::max<size_t>(16, image.rawLength / (sqrt(image.rawLength) * 16) / image.channels);
+    FFT::initReal(segment);
+
+    for (CurveKind kind : {CurveKind::Gilbert, CurveKind::Hilbert, CurveKind::Morton, CurveKind::Snake}) {
+        CurveTable::cleanup();
+
+        auto t0 = std::chrono::steady_clock::now();
+        CurveTable::get(image.width, image.height, nullptr, 0, kind);
+        double build = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+        t0 = std::chrono::steady_clock::now();
+        uint64_t sink = 0;
+        for (long y = 0; y < image.height; y++) {
+            for (long x = 0; x < image.width; x++) {
+                sink += curveKey(kind, x, y, image.width, image.height);
+            }
+        }
+        double keys = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        benchSink += sink;
+
+        image.curve = kind;
+        image.rawToHilb();
+
+        double low = 0, total = 0;
+        FFT::RealBuffer luma(segment);
+        FFT::Buffer waves;
+        for (size_t first = 0; first + segment <= image.length; first += segment) {
+            for (size_t i = 0; i < segment; i++) {
+                const unsigned char* px = &image.hilbMap[image.channels * (first + i)];
+                luma[i] = 0.299 * px[0] + 0.587 * px[1] + 0.114 * px[2];
+            }
+            FFT::forward(luma, waves);
+            // every bin but the nyquist one also stands for its negative twin
+            for (size_t k = 1; k < waves.size(); k++) {
+                double e = std::norm(waves[k]) * (2 * k == segment ? 1 : 2);
+                total += e;
+                if (k <= segment / 16) low += e;
+            }
+        }
+
+        std::cout << curveName(kind) << ": build " << image.length / build / 1e6 << " Mpx/s, keys "
+                  << image.length / keys / 1e6 << " Mpx/s, low band energy " << 100 * low / total << "%\n";
+    }
+}
+
+// partial decodes: gilbxy at every curve position against gilbidx going back, then per
+// curve every segment scattered straight to rawData against the source, and the segments
+// a centred quarter of the image touches against a lookup of its pixels in the curve table
+void benchRegions(Image& image) {
+    auto t0 = std::chrono::steady_clock::now();
+    size_t wrong = 0;
+    for (long i = 0; i < (long)image.length; i++) {
+        GilbertPoint p = gilbxy(i, image.width, image.height);
+        wrong += gilbidx(p.x, p.y, image.width, image.height) != i;
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::cout << "gilbxy: " << image.length / secs / 1e6 << " Mpx/s, " << wrong << " not inverse to gilbidx\n";
+
+    const std::vector<unsigned char> source = image.rawData;
+    long x0 = image.width / 4, y0 = image.height / 4;
+    long x1 = x0 + image.width / 2, y1 = y0 + image.height / 2;
+
+    for (CurveKind kind : {CurveKind::Gilbert, CurveKind::Hilbert, CurveKind::Morton, CurveKind::Snake}) {
+        image.curve = kind;
+        image.rawData = source;
+        image.rawToHilb();
+        image.subsects.clear();
+        image.subdivide(image.hilbMap, sqrt(image.rawLength) * 16);
+
+        std::fill(image.rawData.begin(), image.rawData.end(), 0);
+        t0 = std::chrono::steady_clock::now();
+        for (const auto& s : image.subsects) image.scatterSegment(s);
+        double scatter = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+        t0 = std::chrono::steady_clock::now();
+        std::vector<size_t> hits = image.subsectsIn(x0, y0, x1, y1);
+        double query = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+        std::vector<long> inside;
+        auto table = CurveTable::get(image.width, image.height, nullptr, image.tileSize, kind);
+        for (long y = y0; y < y1; y++) {
+            for (long x = x0; x < x1; x++) inside.push_back(table->forward[x + (size_t)image.width * y]);
+        }
+        std::sort(inside.begin(), inside.end());
+        std::vector<size_t> expected;
+        for (size_t i = 0; i < image.subsects.size(); i++) {
+            long first = image.subsects[i].start / image.channels;
+            long last = (image.subsects[i].end + image.channels - 1) / image.channels;
+            auto it = std::lower_bound(inside.begin(), inside.end(), first);
+            if (it != inside.end() && *it < last) expected.push_back(i);
+        }
+
+        std::cout << curveName(kind) << ": scatter " << image.rawLength / scatter / 1e9 << " GB/s, "
+                  << (image.rawData == source ? "restored" : "differs from the source") << ", quarter "
+                  << hits.size() << " of " << image.subsects.size() << " segments in " << query * 1e6
+                  << " us, " << (hits == expected ? "as" : "differs from") << " the table\n";
+    }
+    image.rawData = source;
+}
+
+// codes every segment of the image and puts the result back in rawData
+template<typename Real>
+void encode(BasicImage<Real>& image, char mode, ThreadPool* pool) {
+    image.rawToHilb(pool);
+    image.subdivide(image.hilbMap, sqrt(image.rawLength) * 16);
+
+    // a batch of segments at a time, so each stays in cache from color conversion to the transforms
+    size_t batch = 256;
+    for (size_t first = 0; first < image.subsects.size(); first += batch) {
+        size_t last = std::min(first + batch, image.subsects.size());
+
+        for (size_t s = first; s < last; s++) {
+            auto& i = image.subsects[s];
+            i.toYCbCr(1, image.chromaScale);
+            
+            // auto wavesY = i.toWaves(i.Y);
+            // FFT::init(i.CbCr.size());
+            // FFT::forward(i.CbCr);
+            // for (auto& a : i.CbCr) a /= i.CbCr.size();
+
+            // i.Y = i.toData(wavesY, i.Y.size());
+            // FFT::backward(i.CbCr);
+            
+            if (mode == 'c') {
+                for (auto& a : i.Y) a = 128.0;
+            }
+            if (mode == 'y') {
+                for (auto& a : i.CbCr) a = typename BasicSubsect<Real>::Complex(128, 128);
+            }
+        }
+
+        image.fromYCbCr(first, last);
+        for (size_t s = first; s < last; s++) {
+            image.subsects[s].integrateRawData(image.hilbMap);
+        }
+    }
+    
+    image.hilbToRaw(pool);
+}
+
+double psnr(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b) {
+    double se = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        double d = (double)a[i] - b[i];
+        se += d * d;
+    }
+    if (se == 0) return std::numeric_limits<double>::infinity();
+    return 10 * std::log10(255.0 * 255.0 * a.size() / se);
+}
+
+// double against float segments: encode time once plans exist, quality of each against
+// the source and how far float strays from double
+void benchPrecision(const Image& image, ThreadPool* pool) {
+    auto timed = [&](auto& img) {
+        auto t0 = std::chrono::steady_clock::now();
+        encode(img, 'n', pool);
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    };
+
+    // first runs plan every length
+    Image warmDouble(image);
+    BasicImage<float> warmFloat(image);
+    timed(warmDouble);
+    timed(warmFloat);
+
+    Image twice(image);
+    BasicImage<float> single(image);
+    double secsDouble = timed(twice);
+    double secsFloat = timed(single);
+
+    std::cout << "double: " << secsDouble * 1e3 << " ms, " << psnr(image.rawData, twice.rawData) << " dB\n";
+    std::cout << "float: " << secsFloat * 1e3 << " ms, " << psnr(image.rawData, single.rawData) << " dB\n";
+    std::cout << "float vs double: " << psnr(twice.rawData, single.rawData) << " dB, "
+              << secsDouble / secsFloat << "x\n";
+}
+
+// per length, ns for a forward and backward transform of one segment in a batch of
+// fftBatch, fftw against the built in code. complex and real (r2c then c2r) in turn
+void benchFFT() {
+    const size_t count = Image::fftBatch;
+
+    auto timeIt = [&](FFTBackend backend, auto&& fn) {
+        FFT::setBackend(backend);
+        fn(); // plans, if any
+        size_t reps = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        double secs = 0;
+        for (; secs < 0.05; secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count()) {
+            for (int r = 0; r < 16; r++) fn();
+            reps += 16;
+        }
+        return secs / (reps * count) * 1e9;
+    };
+
+    std::cout << "length: complex fftw / builtin, real fftw / builtin (ns)\n";
+    for (size_t N : {4, 7, 8, 12, 14, 16, 20, 28, 32, 48, 56, 64, 96, 97, 128, 256, 512}) {
+        FFT::Buffer data(N * count, FFT::Complex(1, 0));
+        FFT::RealBuffer samples(N * count, 1), back;
+        FFT::Buffer half;
+
+        auto complex = [&]() {
+            FFT::forwardMany(data, N);
+            FFT::backwardMany(data, N);
+            for (auto& v : data) v /= (double)N;
+        };
+        auto real = [&]() {
+            FFT::forwardMany(samples, half, N);
+            FFT::backwardMany(half, back, N);
+        };
+
+        double complexFFTW = timeIt(FFTBackend::FFTW, complex);
+        double complexBuiltin = timeIt(FFTBackend::Builtin, complex);
+        double realFFTW = timeIt(FFTBackend::FFTW, real);
+        double realBuiltin = timeIt(FFTBackend::Builtin, real);
+        std::cout << N << (BuiltinFFT<double>::hasKernel(N) ? " (kernel)" : "") << ": "
+                  << complexFFTW << " / " << complexBuiltin << ", " << realFFTW << " / " << realBuiltin << "\n";
+    }
+}
+
 int main(int argc, char** argv) {
     ThreadPool pool(std::thread::hardware_concurrency());
 
+    // optional on-disk cache for the curve tables, e.g. /var/cache/imagecompression
+    if (const char* dir = std::getenv("IMAGECOMPRESSION_CURVE_CACHE")) {
+        CurveTable::setCacheDir(dir);
+        WideCurveTable::setCacheDir(dir);
+    }
+
+    // fft planning: estimate (default), measure, patient or wisdom-only. measured plans
+    // are kept across runs in the wisdom file, e.g. ~/.cache/imagecompression.wisdom
+    // float plans keep their own wisdom beside it, <file>.float
+    if (const char* planning = std::getenv("IMAGECOMPRESSION_FFT_PLANNING")) {
+        FFT::setPlanning(fftPlanningFromName(planning));
+        FFTF::setPlanning(fftPlanningFromName(planning));
+    }
+    if (const char* wisdom = std::getenv("IMAGECOMPRESSION_FFT_WISDOM")) {
+        FFT::setWisdomFile(wisdom);
+        FFTF::setWisdomFile(std::string(wisdom) + ".float");
+    }
+    // plan cache limits, by plan count and by estimated MiB, unlimited by default
+    size_t cachePlans = 0, cacheBytes = 0;
+    if (const char* n = std::getenv("IMAGECOMPRESSION_FFT_CACHE_PLANS")) cachePlans = std::atol(n);
+    if (const char* mb = std::getenv("IMAGECOMPRESSION_FFT_CACHE_MB")) cacheBytes = std::atol(mb) << 20;
+    FFT::setCacheLimits(cachePlans, cacheBytes);
+    FFTF::setCacheLimits(cachePlans, cacheBytes);
+    if (std::getenv("IMAGECOMPRESSION_FFT_VERBOSE")) {
+        FFT::setVerbose(true);
+        FFTF::setVerbose(true);
+    }
+    // fftw (default), builtin, or auto for the built in kernels on short lengths and fftw for the rest
+    if (const char* backend = std::getenv("IMAGECOMPRESSION_FFT_BACKEND")) {
+        FFT::setBackend(fftBackendFromName(backend));
+        FFTF::setBackend(fftBackendFromName(backend));
+    }
+
     char mode = argv[2][0];
 
     Image image;
@@ -314,33 +1094,41 @@ int main(int argc, char** argv) {
     if (argc > 1) filepath = argv[1];
     std::cout << "filepath: " << filepath << "\n";
     image.loadImage(filepath);
-    
-    // encode
-    image.rawToHilb();
-    image.subdivide(image.hilbMap, sqrt(image.rawLength) * 16);
 
-    for (auto &i : image.subsects) {
-        i.toYCbCr(1, 4);
-        
-        // auto wavesY = i.toWaves(i.Y);
-        // FFT::init(i.CbCr.size());
-        // FFT::forward(i.CbCr);
-        // for (auto& a : i.CbCr) a /= i.CbCr.size();
+    // optional tiled curve layout, e.g. 64 or 256
+    if (const char* tile = std::getenv("IMAGECOMPRESSION_TILE")) image.tileSize = std::atol(tile);
+    // gilbert (default), hilbert, morton or snake
+    if (const char* curve = std::getenv("IMAGECOMPRESSION_CURVE")) image.curve = curveFromName(curve);
+    // smooth (default) fft friendly segment lengths, or even for equal splits of any length
+    if (const char* segments = std::getenv("IMAGECOMPRESSION_SEGMENTS")) image.smoothSegments = std::string(segments) != "even";
+    // dft (default) or dct resampling of the luma and chroma
+    if (const char* basis = std::getenv("IMAGECOMPRESSION_BASIS")) image.cosineBasis = std::string(basis) == "dct";
 
-        // i.Y = i.toData(wavesY);
-        // FFT::backward(i.CbCr);
-        
-        if (mode == 'c') {
-            for (auto& a : i.Y) a = 128.0;
-        }
-        if (mode == 'y') {
-            for (auto& a : i.CbCr) a = std::complex<double>(128, 128);
-        }
-
-        i.fromYCbCr();
-        i.integrateRawData(image.hilbMap);
+    // benchmarks: <image> b [remap|curves|regions|precision|fft]
+    if (mode == 'b') {
+        std::string bench = argc > 3 ? argv[3] : "remap";
+        if (bench == "curves") benchCurves(image);
+        else if (bench == "regions") benchRegions(image);
+        else if (bench == "precision") benchPrecision(image, &pool);
+        else if (bench == "fft") benchFFT();
+        else benchRemap(image);
+        FFT::cleanup();
+        FFTF::cleanup();
+        return 0;
     }
     
-    image.hilbToRaw();
-    image.savePPM("img.ppm");
+    // segments in double (default) or float
+    std::string precision = "double";
+    if (const char* p = std::getenv("IMAGECOMPRESSION_FFT_PRECISION")) precision = p;
+
+    if (precision == "float") {
+        BasicImage<float> single(image);
+        encode(single, mode, &pool);
+        single.savePPM("img.ppm");
+    } else {
+        encode(image, mode, &pool);
+        image.savePPM("img.ppm");
+    }
+    FFT::cleanup();
+    FFTF::cleanup();
 }